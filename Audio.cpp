@@ -1,9 +1,171 @@
 #include "Audio.hpp"
 
-// Todo: rework to pick a free channel rather than always using same one.
-
 namespace AudioHandler {
-	AudioHandler::AudioHandler() { }
+	void add_decode_time(ChannelStats& channel, uint32_t time) {
+		channel.decode_us += time;
+		channel.max_decode_us = std::max(channel.max_decode_us, time);
+	}
+
+	// Longest sound which will be decoded into memory (anything longer is streamed)
+	const uint32_t MAX_CACHED_SAMPLES = blit::sample_rate * 2;
+
+	// Most samples one mp3 frame can turn into (after resampling to output rate)
+	const uint32_t MAX_FRAME_OUTPUT_SAMPLES = MINIMP3_MAX_SAMPLES_PER_FRAME;
+
+	// Decodes one mp3 frame, converting it to mono at the output sample rate and passing each sample to output.
+	// Returns number of bytes of mp3 data used (0 if there are no more frames).
+	template<typename Output>
+	uint32_t decode_mp3_frame(mp3dec_t* decoder, const uint8_t* data, uint32_t size, mp3d_sample_t* frame, uint32_t& resample_phase, Output output) {
+		mp3dec_frame_info_t info;
+		int frame_samples = mp3dec_decode_frame(decoder, data, size, frame, &info);
+
+		if (frame_samples == 0 || info.hz == 0) {
+			// Skipped data (e.g. ID3 tag), or no more frames
+			return info.frame_bytes;
+		}
+
+		for (int i = 0; i < frame_samples; i++) {
+			// Mix down to mono
+			int32_t sample = frame[i * info.channels];
+			if (info.channels == 2) {
+				sample = (sample + frame[i * 2 + 1]) / 2;
+			}
+
+			// Nearest neighbour resample to output rate
+			resample_phase += blit::sample_rate;
+			while (resample_phase >= (uint32_t)info.hz) {
+				resample_phase -= info.hz;
+				output(sample);
+			}
+		}
+
+		return info.frame_bytes;
+	}
+
+	void MusicStreamer::load(const uint8_t mp3_data[], const uint32_t mp3_size) {
+		stop();
+
+		reset_track(mp3_data, mp3_size);
+
+		// Get some audio ready straight away, so that there isn't a gap at the start (update() decodes the rest)
+		update(MUSIC_DECODE_BUDGET_US);
+	}
+
+	void MusicStreamer::play(uint8_t audio_channel, uint8_t flags) {
+		blit::AudioChannel& output = blit::channels[audio_channel];
+
+		output.off();
+
+		channel = audio_channel;
+		loop = flags & 0b1;
+
+		if (track.read_position != 0) {
+			// Already been played, restart from the beginning
+			load(track.data, track.size);
+		}
+
+		if (loop && track.finished) {
+			// Whole track was decoded before we knew it should loop, so carry on decoding from the start
+			track.offset = 0;
+			track.finished = false;
+			mp3dec_init(&track.decoder);
+		}
+
+		output.waveforms = blit::Waveform::WAVE;
+		output.wave_buffer_callback = &MusicStreamer::callback;
+		output.user_data = &track;
+
+		output.attack_ms = 0;
+		output.decay_ms = 0;
+		output.sustain = 0xffff;
+		output.release_ms = 0;
+
+		output.trigger_attack();
+	}
+
+	void MusicStreamer::stop() {
+		blit::channels[channel].off();
+	}
+
+	// Decodes until the buffers are full or budget_us has been used
+	void MusicStreamer::update(uint32_t budget_us) {
+		uint32_t start = blit::now_us();
+
+		while (track.data && !track.finished && track.write_position - track.read_position <= MUSIC_BUFFER_SIZE - MAX_FRAME_OUTPUT_SAMPLES) {
+			decode_frame();
+
+			if (blit::us_diff(start, blit::now_us()) >= budget_us) {
+				return;
+			}
+		}
+	}
+
+	void MusicStreamer::reset_track(const uint8_t mp3_data[], const uint32_t mp3_size) {
+		track.data = mp3_data;
+		track.size = mp3_size;
+		track.offset = 0;
+		track.resample_phase = 0;
+		track.finished = false;
+		track.write_position = 0;
+		track.read_position = 0;
+		track.stats = stats;
+
+		mp3dec_init(&track.decoder);
+	}
+
+	// Decodes one frame into the track's buffer, returns false if there was nothing left
+	bool MusicStreamer::decode_frame() {
+		uint32_t bytes = decode_mp3_frame(&track.decoder, track.data + track.offset, track.size - track.offset, frame, track.resample_phase, [this](int16_t sample) {
+			track.buffer[track.write_position & (MUSIC_BUFFER_SIZE - 1)] = sample;
+			track.write_position = track.write_position + 1;
+		});
+
+		track.offset += bytes;
+
+		if (stats) {
+			stats->bytes_decoded += bytes;
+		}
+
+		if (bytes == 0 || track.offset >= track.size) {
+			if (loop) {
+				track.offset = 0;
+				mp3dec_init(&track.decoder);
+			}
+			else {
+				track.finished = true;
+			}
+		}
+
+		return bytes != 0;
+	}
+
+	// Called from the audio interrupt, so just copies samples
+	void MusicStreamer::callback(blit::AudioChannel& channel) {
+		MusicTrack* track = (MusicTrack*)channel.user_data;
+
+		for (uint8_t i = 0; i < 64; i++) {
+			if (track->read_position == track->write_position) {
+				// Nothing decoded (yet)
+				channel.wave_buffer[i] = 0;
+
+				if (track->finished) {
+					channel.off();
+				}
+				else if (i == 0 && track->stats) {
+					// Decoding hasn't kept up
+					track->stats->underruns++;
+				}
+				continue;
+			}
+
+			channel.wave_buffer[i] = track->buffer[track->read_position & (MUSIC_BUFFER_SIZE - 1)];
+			track->read_position = track->read_position + 1;
+		}
+	}
+
+	AudioHandler::AudioHandler() {
+		music.stats = &stats.channels[MUSIC_CHANNEL];
+	}
 
 	void AudioHandler::set_volume(uint32_t volume) {
 		for (uint8_t i = 0; i < 8; i++) {
@@ -15,22 +177,134 @@ namespace AudioHandler {
 		blit::channels[channel].volume = volume;
 	}
 
-	void AudioHandler::load(uint8_t channel, const uint8_t mp3_data[], const uint32_t mp3_size) {
-		if (channel > 7) {
+	// Registers a sound which is streamed from mp3 when played
+	void AudioHandler::load(uint8_t sound, const uint8_t mp3_data[], const uint32_t mp3_size, uint8_t priority) {
+		if (sound >= MAX_SOUNDS) {
+			return;
+		}
+		blit::File::add_buffer_file(filenames[sound], mp3_data, mp3_size);
+
+		sounds[sound].loaded = true;
+		sounds[sound].priority = priority;
+		sounds[sound].cache.samples.clear();
+
+		// Any channels which had the old sound loaded need to reload it
+		for (uint8_t i = 0; i < SFX_CHANNELS; i++) {
+			if (voices[i].sound == sound) {
+				voices[i].sound = NO_SOUND;
+			}
+		}
+	}
+
+	// Decodes a short sound effect into memory, falls back to streaming it if it can't be decoded or is too long
+	bool AudioHandler::load_cached(uint8_t sound, const uint8_t mp3_data[], const uint32_t mp3_size, uint8_t priority) {
+		if (sound >= MAX_SOUNDS) {
+			return false;
+		}
+
+		// Still register the file, so that it can be streamed if needed
+		load(sound, mp3_data, mp3_size, priority);
+
+		stats.cache_bytes_decoded += mp3_size;
+
+		if (!decode(mp3_data, mp3_size, sounds[sound].cache.samples)) {
+			sounds[sound].cache.samples.clear();
+			sounds[sound].cache.samples.shrink_to_fit();
+			return false;
+		}
+
+		return true;
+	}
+
+	void AudioHandler::load_music(const uint8_t mp3_data[], const uint32_t mp3_size) {
+		music.load(mp3_data, mp3_size);
+	}
+
+	// Minimum time (in ms) between the same sound being started
+	void AudioHandler::set_rate_limit(uint8_t sound, uint16_t interval_ms) {
+		if (sound < MAX_SOUNDS) {
+			sounds[sound].min_interval_ms = interval_ms;
+		}
+	}
+
+	// Queues sound to be played at the end of the frame (see flush).
+	// Playing the same sound more than once in a frame only starts it once.
+	void AudioHandler::play(uint8_t sound, uint8_t flags) {
+		if (sound >= MAX_SOUNDS || !sounds[sound].loaded) {
 			return;
 		}
-		blit::File::add_buffer_file(filenames[channel], mp3_data, mp3_size);
-		load(channel, channel);
+
+		stats.events_queued++;
+
+		for (uint8_t i = 0; i < queued_count; i++) {
+			if (queued_sounds[i].sound == sound) {
+				queued_sounds[i].flags |= flags;
+				stats.events_deduped++;
+				return;
+			}
+		}
+
+		queued_sounds[queued_count].sound = sound;
+		queued_sounds[queued_count].flags = flags;
+		queued_count++;
 	}
 
-	void AudioHandler::load(uint8_t target_channel, uint8_t source_channel) {
-		mp3_channels[target_channel].load(filenames[source_channel]);
+	// Starts everything queued this frame, apart from sounds which were started too recently
+	void AudioHandler::flush() {
+		uint32_t time = blit::now();
+
+		for (uint8_t i = 0; i < queued_count; i++) {
+			Sound& sound = sounds[queued_sounds[i].sound];
+
+			if (sound.started && time - sound.last_started < sound.min_interval_ms) {
+				stats.events_rate_limited++;
+				continue;
+			}
+
+			uint8_t channel = start(queued_sounds[i].sound, queued_sounds[i].flags);
+
+			if (channel != NO_CHANNEL) {
+				sound.started = true;
+				sound.last_started = time;
+				stats.channels[channel].restarts++;
+			}
+			else {
+				stats.events_dropped++;
+			}
+		}
+
+		queued_count = 0;
 	}
 
-	void AudioHandler::play(uint8_t channel, uint8_t flags) {
-		mp3_channels[channel].pause();
-		mp3_channels[channel].restart();
-		mp3_channels[channel].play(channel, flags);
+	// Plays sound on whichever channel is free (or least important), returns channel used, or NO_CHANNEL if it wasn't played
+	uint8_t AudioHandler::start(uint8_t sound, uint8_t flags) {
+		uint8_t channel = allocate_voice(sound);
+		if (channel == NO_CHANNEL) {
+			return NO_CHANNEL;
+		}
+
+		voices[channel].priority = sounds[sound].priority;
+		voices[channel].last_used = blit::now();
+
+		if (sounds[sound].cache.samples.size()) {
+			play_cached(channel, sound, flags);
+		}
+		else {
+			if (voices[channel].sound != sound) {
+				mp3_channels[channel].load(filenames[sound]);
+			}
+			mp3_channels[channel].pause();
+			mp3_channels[channel].restart();
+			mp3_channels[channel].play(channel, flags);
+		}
+
+		voices[channel].sound = sound;
+
+		return channel;
+	}
+
+	void AudioHandler::play_music(uint8_t flags) {
+		music.play(MUSIC_CHANNEL, flags);
 	}
 
 	bool AudioHandler::is_playing(uint8_t channel) {
@@ -38,8 +312,168 @@ namespace AudioHandler {
 	}
 
 	void AudioHandler::update() {
+		uint32_t update_start = blit::now_us();
+
+		flush();
+
+		for (uint8_t i = 0; i < SFX_CHANNELS; i++) {
+			if (voices[i].sound != NO_SOUND && !sounds[voices[i].sound].cache.samples.size()) {
+				uint32_t start = blit::now_us();
+				mp3_channels[i].update();
+				add_decode_time(stats.channels[i], blit::us_diff(start, blit::now_us()));
+			}
+		}
+
+		uint32_t start = blit::now_us();
+		music.update(MUSIC_DECODE_BUDGET_US);
+		add_decode_time(stats.channels[MUSIC_CHANNEL], blit::us_diff(start, blit::now_us()));
+
+		uint32_t update_time = blit::us_diff(update_start, blit::now_us());
+		stats.update_us += update_time;
+		stats.max_update_us = std::max(stats.max_update_us, update_time);
+		stats.updates++;
+	}
+
+	const AudioStats& AudioHandler::get_stats() {
+		return stats;
+	}
+
+	void AudioHandler::reset_stats() {
+		stats = AudioStats();
+	}
+
+	void AudioHandler::print_stats() {
+		printf("Audio: %lu updates, avg %lu us, max %lu us\n", (unsigned long)stats.updates, (unsigned long)(stats.updates ? stats.update_us / stats.updates : 0), (unsigned long)stats.max_update_us);
+		printf("Audio events: %lu queued, %lu deduped, %lu rate limited, %lu dropped. Sfx cache: %lu bytes decoded\n", (unsigned long)stats.events_queued, (unsigned long)stats.events_deduped, (unsigned long)stats.events_rate_limited, (unsigned long)stats.events_dropped, (unsigned long)stats.cache_bytes_decoded);
+
 		for (uint8_t i = 0; i < 8; i++) {
-			mp3_channels[i].update();
+			ChannelStats& channel = stats.channels[i];
+			printf("  Channel %d%s: decode %lu us (max %lu us), %lu bytes, %lu underruns, %lu restarts, %lu steals\n", i, i == MUSIC_CHANNEL ? " (music)" : "", (unsigned long)channel.decode_us, (unsigned long)channel.max_decode_us, (unsigned long)channel.bytes_decoded, (unsigned long)channel.underruns, (unsigned long)channel.restarts, (unsigned long)channel.steals);
+		}
+	}
+
+	uint8_t AudioHandler::allocate_voice(uint8_t sound) {
+		uint8_t idle_channel = NO_CHANNEL;
+		uint8_t steal_channel = NO_CHANNEL;
+
+		for (uint8_t i = 0; i < SFX_CHANNELS; i++) {
+			if (!is_playing(i)) {
+				if (voices[i].sound == sound) {
+					// Already has this sound loaded, so no need to reload it
+					return i;
+				}
+
+				// Otherwise use the idle channel which was used longest ago
+				if (idle_channel == NO_CHANNEL || voices[i].last_used < voices[idle_channel].last_used) {
+					idle_channel = i;
+				}
+			}
+			else if (voices[i].priority <= sounds[sound].priority) {
+				// Lowest priority, then oldest, playing sound can be stopped if there's nothing free
+				if (steal_channel == NO_CHANNEL || voices[i].priority < voices[steal_channel].priority || (voices[i].priority == voices[steal_channel].priority && voices[i].last_used < voices[steal_channel].last_used)) {
+					steal_channel = i;
+				}
+			}
+		}
+
+		if (idle_channel != NO_CHANNEL) {
+			return idle_channel;
+		}
+
+		if (steal_channel != NO_CHANNEL) {
+			blit::channels[steal_channel].off();
+			stats.channels[steal_channel].steals++;
+		}
+
+		return steal_channel;
+	}
+
+	// Decodes whole mp3 into mono samples at the output sample rate
+	bool AudioHandler::decode(const uint8_t mp3_data[], const uint32_t mp3_size, std::vector<int16_t>& samples) {
+		samples.clear();
+
+		// Decoder state is a few KB, so keep it off the stack
+		mp3dec_t* decoder = new mp3dec_t;
+		std::vector<mp3d_sample_t> frame(MINIMP3_MAX_SAMPLES_PER_FRAME);
+		mp3dec_init(decoder);
+
+		uint32_t offset = 0;
+		uint32_t resample_phase = 0;
+		bool success = true;
+
+		while (offset < mp3_size) {
+			uint32_t bytes = decode_mp3_frame(decoder, mp3_data + offset, mp3_size - offset, frame.data(), resample_phase, [&samples](int16_t sample) {
+				samples.push_back(sample);
+			});
+
+			if (bytes == 0) {
+				// No more frames
+				break;
+			}
+			offset += bytes;
+
+			if (samples.size() > MAX_CACHED_SAMPLES) {
+				// Too long, should be streamed instead
+				success = false;
+				break;
+			}
+		}
+
+		delete decoder;
+
+		if (samples.size() == 0) {
+			success = false;
+		}
+
+		samples.shrink_to_fit();
+
+		return success;
+	}
+
+	void AudioHandler::play_cached(uint8_t channel, uint8_t sound, uint8_t flags) {
+		blit::AudioChannel& audio_channel = blit::channels[channel];
+
+		// Stop the channel before changing the voice, so that the callback doesn't see it half updated
+		audio_channel.off();
+
+		cached_voices[channel].sound = &sounds[sound].cache;
+		cached_voices[channel].position = 0;
+		cached_voices[channel].loop = flags & 0b1;
+
+		audio_channel.waveforms = blit::Waveform::WAVE;
+		audio_channel.wave_buffer_callback = &AudioHandler::cached_callback;
+		audio_channel.user_data = &cached_voices[channel];
+
+		audio_channel.attack_ms = 0;
+		audio_channel.decay_ms = 0;
+		audio_channel.sustain = 0xffff;
+		audio_channel.release_ms = 0;
+
+		audio_channel.trigger_attack();
+	}
+
+	// Called from the audio interrupt, so just copies samples
+	void AudioHandler::cached_callback(blit::AudioChannel& channel) {
+		CachedVoice* voice = (CachedVoice*)channel.user_data;
+
+		const std::vector<int16_t>& samples = voice->sound->samples;
+
+		for (uint8_t i = 0; i < 64; i++) {
+			if (voice->position >= samples.size()) {
+				if (voice->loop) {
+					voice->position = 0;
+				}
+				else {
+					// Finished, pad the rest of the buffer with silence
+					for (; i < 64; i++) {
+						channel.wave_buffer[i] = 0;
+					}
+					channel.off();
+					return;
+				}
+			}
+
+			channel.wave_buffer[i] = samples[voice->position++];
 		}
 	}
-}
\ No newline at end of file
+}
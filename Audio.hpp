@@ -3,7 +3,124 @@
 #include "32blit.hpp"
 #include "audio/mp3-stream.hpp"
 
+#include "minimp3.h"
+
 namespace AudioHandler {
+	const uint8_t MAX_SOUNDS = 8;
+	const uint8_t SFX_CHANNELS = 7; // channels 0-6 are shared between sfx
+	const uint8_t MUSIC_CHANNEL = 7;
+
+	const uint8_t NO_SOUND = 0xff;
+	const uint8_t NO_CHANNEL = 0xff;
+
+	// Same sound won't be started again within this time, unless set_rate_limit is used
+	const uint16_t DEFAULT_SOUND_INTERVAL_MS = 40;
+
+	// Short sound effect decoded into memory, so that playing it doesn't need any mp3 decoding
+	struct CachedSound {
+		std::vector<int16_t> samples;
+	};
+
+	// Playback state for a channel which is playing a CachedSound (read from the audio callback)
+	struct CachedVoice {
+		const CachedSound* sound = nullptr;
+		uint32_t position = 0;
+		bool loop = false;
+	};
+
+	struct Sound {
+		bool loaded = false;
+		// Higher priority sounds can take a channel from lower priority ones if all channels are busy
+		uint8_t priority = 0;
+		uint16_t min_interval_ms = DEFAULT_SOUND_INTERVAL_MS;
+		uint32_t last_started = 0;
+		bool started = false;
+		CachedSound cache;
+	};
+
+	// Request to play a sound, queued until the end of the frame
+	struct SoundEvent {
+		uint8_t sound;
+		uint8_t flags;
+	};
+
+	// Sfx channel, and which sound it currently has loaded
+	struct Voice {
+		uint8_t sound = NO_SOUND;
+		uint8_t priority = 0;
+		uint32_t last_used = 0;
+	};
+
+	// Timing/usage counters for one channel (since last reset_stats)
+	struct ChannelStats {
+		uint32_t decode_us = 0; // total time spent in update() for this channel
+		uint32_t max_decode_us = 0; // longest single update()
+		uint32_t bytes_decoded = 0; // mp3 bytes decoded (music and sfx cache only, MP3Stream doesn't report this)
+		uint32_t underruns = 0; // buffer callbacks with no decoded samples ready (music only)
+		uint32_t restarts = 0; // sounds started by play()
+		uint32_t steals = 0; // sounds stopped early to make room for a higher priority one
+	};
+
+	struct AudioStats {
+		ChannelStats channels[8];
+		uint32_t update_us = 0; // total time spent in AudioHandler::update()
+		uint32_t max_update_us = 0;
+		uint32_t updates = 0;
+		uint32_t events_queued = 0;
+		uint32_t events_deduped = 0; // same sound requested again in the same frame
+		uint32_t events_rate_limited = 0; // dropped because sound was started too recently
+		uint32_t events_dropped = 0; // no free channel
+		uint32_t cache_bytes_decoded = 0; // mp3 bytes decoded into sfx cache at load
+	};
+
+	// Size of the music track's decoded sample buffer (must be a power of 2)
+	const uint32_t MUSIC_BUFFER_SIZE = 8192;
+	// Time allowed for decoding music each frame
+	const uint32_t MUSIC_DECODE_BUDGET_US = 2000;
+
+	// Music track being decoded into a ring buffer, which the audio callback reads from
+	struct MusicTrack {
+		const uint8_t* data = nullptr;
+		uint32_t size = 0;
+		uint32_t offset = 0;
+		uint32_t resample_phase = 0;
+		bool finished = false; // reached end of data (and not looping)
+
+		mp3dec_t decoder;
+
+		int16_t buffer[MUSIC_BUFFER_SIZE];
+		ChannelStats* stats = nullptr;
+
+		// Only written by decoder (write_position) or audio callback (read_position)
+		volatile uint32_t write_position = 0;
+		volatile uint32_t read_position = 0;
+	};
+
+	// Streams music without decoding a whole frame's worth at once (which MP3Stream can do, causing a spike).
+	// Decoding happens in slices limited by a time budget, including the first slice when a track is loaded or restarted.
+	class MusicStreamer {
+	public:
+		void load(const uint8_t[], const uint32_t);
+		void play(uint8_t, uint8_t = 0);
+		void stop();
+		void update(uint32_t);
+
+		// Owned by the AudioHandler, used to count decoded bytes and underruns
+		ChannelStats* stats = nullptr;
+
+	protected:
+		void reset_track(const uint8_t[], const uint32_t);
+		bool decode_frame();
+
+		static void callback(blit::AudioChannel&);
+
+		MusicTrack track;
+		bool loop = false;
+		uint8_t channel = MUSIC_CHANNEL;
+
+		mp3d_sample_t frame[MINIMP3_MAX_SAMPLES_PER_FRAME];
+	};
+
 	class AudioHandler {
 	public:
 		AudioHandler();
@@ -11,16 +128,42 @@ namespace AudioHandler {
 		void set_volume(uint32_t = 0xffff);
 		void set_volume(uint8_t, uint32_t);
 		
-		void load(uint8_t, const uint8_t[], const uint32_t);
-		void load(uint8_t, uint8_t);
+		void load(uint8_t, const uint8_t[], const uint32_t, uint8_t = 0);
+		bool load_cached(uint8_t, const uint8_t[], const uint32_t, uint8_t = 0);
+		void load_music(const uint8_t[], const uint32_t);
+		void set_rate_limit(uint8_t, uint16_t);
 		void play(uint8_t, uint8_t = 0);
+		void play_music(uint8_t = 0);
 		bool is_playing(uint8_t);
 		void update();
 
+		const AudioStats& get_stats();
+		void reset_stats();
+		void print_stats();
+
 	protected:
-		blit::MP3Stream mp3_channels[8];
-		const char* filenames[8] = {
+		void flush();
+		uint8_t start(uint8_t, uint8_t);
+		uint8_t allocate_voice(uint8_t);
+		bool decode(const uint8_t[], const uint32_t, std::vector<int16_t>&);
+		void play_cached(uint8_t, uint8_t, uint8_t);
+
+		static void cached_callback(blit::AudioChannel&);
+
+		blit::MP3Stream mp3_channels[SFX_CHANNELS];
+		MusicStreamer music;
+		const char* filenames[MAX_SOUNDS] = {
 			"temp0.mp3", "temp1.mp3", "temp2.mp3", "temp3.mp3", "temp4.mp3", "temp5.mp3", "temp6.mp3", "temp7.mp3"
 		};
+
+		Sound sounds[MAX_SOUNDS];
+		Voice voices[SFX_CHANNELS];
+		CachedVoice cached_voices[SFX_CHANNELS];
+
+		// Sounds requested this frame (at most one event per sound)
+		SoundEvent queued_sounds[MAX_SOUNDS];
+		uint8_t queued_count = 0;
+
+		AudioStats stats;
 	};
-}
\ No newline at end of file
+}
@@ -10,9 +10,18 @@ using namespace blit;
 // e.g. screen.sprite(id, Point(x, y), Point(0, 0), 2.0f, SpriteTransform::NONE
 
 #define RESET_SAVE_DATA_IF_MINOR_DIFF
+// Decode sfx into memory at startup (uses ~100KB RAM), only music is streamed from mp3
+#define CACHE_SFX
+// Draw parallax layers from pre-blended off-screen strips instead of blending every tile each frame
+#define PREBLEND_PARALLAX
+// Print audio decode timings, underruns and channel usage every AUDIO_STATS_INTERVAL ms
+//#define PRINT_AUDIO_STATS
+// Print how many background tiles were dropped for being hidden behind the foreground, when each level loads
+//#define PRINT_OCCLUSION_STATS
 //#define TESTING_MODE
 
 void init_game();
+void init_deferred();
 
 const uint16_t SCREEN_WIDTH = 160;
 const uint16_t SCREEN_HEIGHT = 120;
@@ -29,6 +38,12 @@ const float FRAME_LENGTH = 0.15f;
 const float TRANSITION_FRAME_LENGTH = 0.1f;
 const float TRANSITION_CLOSE_LENGTH = 0.5f;
 
+const uint32_t AUDIO_STATS_INTERVAL = 10000;
+
+// Low-power idle mode (menus and pause screen)
+const uint32_t IDLE_UPDATE_INTERVAL = 50; // ms between updates while idle
+const uint32_t IDLE_WAKE_TIME = 1000; // ms after the last input before going idle again
+
 const uint16_t TILE_ID_EMPTY = 255;
 const uint16_t TILE_ID_COIN = 384;
 const uint16_t TILE_ID_PLAYER_1 = 192;
@@ -87,13 +102,24 @@ const uint8_t SPRITE_SIZE = 8;
 
 const uint8_t SG_ICON_SIZE = SPRITE_SIZE * 4;
 
-const float SNOW_LEVEL_GENERATE_DELAY = 0.1f;
-const float SNOW_LEVEL_SELECT_GENERATE_DELAY = 0.15f;
-const uint16_t SNOW_LEVEL_INIT_COUNT = 300;
-const uint16_t SNOW_LEVEL_SELECT_INIT_COUNT = 200;
+// Snow is a fixed set of flakes which wrap around the view (plus a margin so they don't pop in at the edges)
+const uint8_t SNOW_FIELD_MARGIN = SPRITE_SIZE;
+const uint16_t SNOW_FIELD_WIDTH = SCREEN_WIDTH + SNOW_FIELD_MARGIN * 2;
+const uint16_t SNOW_FIELD_HEIGHT = SCREEN_HEIGHT + SNOW_FIELD_MARGIN * 2;
+// Roughly the number of flakes which used to be on screen at once
+const uint8_t SNOW_FIELD_LEVEL_COUNT = 16;
+const uint8_t SNOW_FIELD_LEVEL_SELECT_COUNT = 24;
+const uint8_t SNOW_FIELD_MAX_COUNT = 24;
 
 const float SCREEN_SHAKE_SHAKINESS = 3.0f; //pixels either way - maybe more?
 
+// Quality governor
+const uint32_t QUALITY_FRAME_BUDGET_US = 16000; // update + render time to aim for
+const float QUALITY_HEADROOM = 0.7f; // raise quality again once frames fit in this fraction of the budget
+const uint8_t QUALITY_DOWN_FRAMES = 10; // frames over budget before lowering quality
+const uint16_t QUALITY_UP_FRAMES = 120; // frames with headroom before raising quality
+const uint8_t QUALITY_LEVELS = 4;
+
 const float REPEL_PLAYER_MIN = 5.0f;
 
 
@@ -121,11 +147,18 @@ const float CHECKPOINT_PARTICLE_SPEED = 70.0f;
 
 const float FINISH_PARTICLE_SPAWN_DELAY = 0.05f;
 
+// Off-screen particles are only updated every this many frames (1 updates them every frame)
+const uint8_t OFFSCREEN_PARTICLE_UPDATE_INTERVAL = 4;
+
 const float GRAVITY = 600.0f;
 const float GRAVITY_MAX = 190.0f;
 const float PROJECTILE_GRAVITY = 55.0f;
 const float PROJECTILE_GRAVITY_MAX = 100.0f;
 
+const uint16_t MAX_PROJECTILES = 48;
+// How far outside the camera's view projectiles can go before they are removed
+const float PROJECTILE_CULL_MARGIN = SPRITE_SIZE * 4;
+
 
 const uint8_t PLAYER_START_LIVES = 3;
 const uint8_t PLAYER_MAX_HEALTH = 3;
@@ -262,18 +295,46 @@ const uint16_t SCREEN_MID_HEIGHT = SCREEN_HEIGHT / 2;
 const uint8_t SPRITE_HALF = SPRITE_SIZE / 2;
 const uint8_t SPRITE_QUARTER = SPRITE_SIZE / 4;
 
-const uint16_t SCREEN_TILE_SIZE = (SCREEN_WIDTH / SPRITE_SIZE) * (SCREEN_HEIGHT / SPRITE_SIZE);
+const uint8_t TRANSITION_COLUMNS = SCREEN_WIDTH / SPRITE_SIZE;
+const uint8_t TRANSITION_ROWS = SCREEN_HEIGHT / SPRITE_SIZE;
+
+// Read-only view of a constant table.
+// Lets the tables be constexpr arrays (which stay in flash) instead of vectors copied to the heap at startup.
+template<typename T>
+class Span {
+public:
+    constexpr Span() : items(nullptr), count(0) {
+
+    }
+
+    template<size_t N>
+    constexpr Span(const T (&array)[N]) : items(array), count(N) {
+
+    }
+
+    constexpr const T& operator[](size_t index) const {
+        return items[index];
+    }
+
+    constexpr size_t size() const {
+        return count;
+    }
+
+protected:
+    const T* items;
+    size_t count;
+};
 
 const uint8_t enemyHealths[] = { 1, 1, 1, 1, 2, 2, 2, 2, 1 };
 const uint8_t bossHealths[] = { 3, 3, 3 };
 const uint8_t bigBossMinions[] = { 7, 6, 4 };
 
-const std::vector<uint16_t> coinFrames = { TILE_ID_COIN, TILE_ID_COIN + 1, TILE_ID_COIN + 2, TILE_ID_COIN + 3, TILE_ID_COIN + 2, TILE_ID_COIN + 1 };
+constexpr uint16_t coinFrames[] = { TILE_ID_COIN, TILE_ID_COIN + 1, TILE_ID_COIN + 2, TILE_ID_COIN + 3, TILE_ID_COIN + 2, TILE_ID_COIN + 1 };
 
-const std::vector<uint16_t> finishFrames = { TILE_ID_FINISH, TILE_ID_FINISH + 1, TILE_ID_FINISH + 2, TILE_ID_FINISH + 3, TILE_ID_FINISH + 4, TILE_ID_FINISH + 5 };
+constexpr uint16_t finishFrames[] = { TILE_ID_FINISH, TILE_ID_FINISH + 1, TILE_ID_FINISH + 2, TILE_ID_FINISH + 3, TILE_ID_FINISH + 4, TILE_ID_FINISH + 5 };
 
-const std::vector<uint16_t> transitionFramesClose = { TILE_ID_TRANSITION, TILE_ID_TRANSITION + 1, TILE_ID_TRANSITION + 2, TILE_ID_TRANSITION + 3, TILE_ID_TRANSITION + 4, TILE_ID_TRANSITION + 6, TILE_ID_TRANSITION + 7};
-const std::vector<uint16_t> transitionFramesOpen = { TILE_ID_TRANSITION + 6, TILE_ID_TRANSITION + 5, TILE_ID_TRANSITION + 4, TILE_ID_TRANSITION + 3, TILE_ID_TRANSITION + 2, TILE_ID_TRANSITION + 1, TILE_ID_TRANSITION};
+constexpr uint16_t transitionFramesClose[] = { TILE_ID_TRANSITION, TILE_ID_TRANSITION + 1, TILE_ID_TRANSITION + 2, TILE_ID_TRANSITION + 3, TILE_ID_TRANSITION + 4, TILE_ID_TRANSITION + 6, TILE_ID_TRANSITION + 7};
+constexpr uint16_t transitionFramesOpen[] = { TILE_ID_TRANSITION + 6, TILE_ID_TRANSITION + 5, TILE_ID_TRANSITION + 4, TILE_ID_TRANSITION + 3, TILE_ID_TRANSITION + 2, TILE_ID_TRANSITION + 1, TILE_ID_TRANSITION};
 
 const float parallaxFactorLayersX[2] = {
     0.4f,
@@ -301,14 +362,14 @@ const uint8_t* asset_levels[] = {
     asset_level_level_select
 };
 
-std::vector<uint16_t> snowParticleImages = {
+constexpr uint16_t snowParticleImages[] = {
     464,
     465
 };
 
 
 
-const std::string messageStrings[MESSAGE_STRINGS_COUNT][INPUT_TYPE_COUNT] = {
+constexpr const char* messageStrings[MESSAGE_STRINGS_COUNT][INPUT_TYPE_COUNT] = {
     {
         "Press A to Start",
         "Press U to Start"
@@ -541,16 +602,23 @@ uint16_t levelDeathBoundary;
 float dt;
 uint32_t lastTime = 0;
 
-Surface* sg_icon_image = Surface::load(asset_scorpion_games);
-Surface* background_image = Surface::load(asset_background);
+// Loaded in init() and init_deferred(), rather than during static initialisation
+Surface* sg_icon_image = nullptr;
+Surface* background_image = nullptr;
+
+// Startup timeline
+uint32_t startupTime = 0;
+uint32_t startupPhaseTime = 0;
+
+// Set once everything not needed by the splash screen has been loaded
+bool deferredInitDone = false;
+bool splashRendered = false;
 
 AudioHandler::AudioHandler audioHandler;
 
 bool menuBack = false; // tells menu to go backwards instead of forwards.
 bool gamePaused = false; // used for determining if game is paused or not.
 
-bool coinSfxAlternator = false; // used for alternating channel used for coin pickup sfx
-
 bool cameraIntro = false;
 bool cameraRespawn = false;
 bool cameraNewWorld = false;
@@ -565,7 +633,6 @@ uint8_t pauseMenuItem = 0;
 uint8_t menuItem = 0;
 uint8_t settingsItem = 0;
 
-float snowGenTimer = 0.0f;
 
 bool slowPlayer = false;
 bool dropPlayer = false;
@@ -637,26 +704,66 @@ struct GameSaveData {
     bool checkpoints;
     bool musicVolume;
     bool sfxVolume;
-} gameSaveData;
+};
 
 struct PlayerSaveData {
     uint8_t levelReached;
 };
-PlayerSaveData allPlayerSaveData[2];
 
 struct LevelSaveData {
     uint8_t score;
     uint8_t enemiesKilled;
     float time;
 };
-LevelSaveData allLevelSaveData[2][LEVEL_COUNT];
 
+// All save data is kept in RAM in one image, which is written to a single slot.
+// Changing a record only marks it dirty, flush_save() then snapshots the whole image,
+// and the snapshot is written later by update_save() (write-behind) so gameplay doesn't stall.
+// When the level complete screen starts (screen covered by the transition), save_now() writes it straight away instead.
+const uint32_t SAVE_IMAGE_MAGIC = 0x53534253; // "SSBS"
+const uint16_t SAVE_IMAGE_FORMAT = 1; // Increase if the layout of SaveImage changes
+
+struct SaveImage {
+    uint32_t magic;
+    uint16_t format;
+    uint16_t size;
+    GameSaveData game;
+    PlayerSaveData players[2];
+    LevelSaveData levels[2][LEVEL_COUNT];
+    uint32_t checksum; // Must be last, covers everything before it
+} saveImage;
 
+GameSaveData& gameSaveData = saveImage.game;
+PlayerSaveData (&allPlayerSaveData)[2] = saveImage.players;
+LevelSaveData (&allLevelSaveData)[2][LEVEL_COUNT] = saveImage.levels;
+
+// Dirty bit for each record in saveImage
+const uint8_t SAVE_RECORD_GAME = 0;
+const uint8_t SAVE_RECORD_PLAYER = 1; // + playerID
+const uint8_t SAVE_RECORD_LEVEL = 3; // + playerID * LEVEL_COUNT + levelNumber
+const uint32_t SAVE_RECORDS_ALL = (1 << (SAVE_RECORD_LEVEL + 2 * LEVEL_COUNT)) - 1;
+
+uint32_t saveDirty = 0;
+
+// Snapshot waiting to be written
+SaveImage pendingSaveImage;
+bool savePending = false;
+float savePendingTimer = 0.0f;
+
+// Longest a snapshot waits for a quiet frame (screen covered by the transition) before being written anyway
+const float SAVE_WRITE_DELAY = 2.0f;
+
+bool saveLoaded = false;
+
+
+// Legacy layout (before the save image), only read to migrate old saves:
 // 0 slot is gameSaveData
 // 1 slot is player 1 saveData
 // 2..257 slots are player 1 levelData
 // 258 slot is player 2 saveData
 // 259..514 slots are player 2 levelData
+// 515 slot is the save image
+const uint16_t SAVE_IMAGE_SLOT = 2 * (BYTE_SIZE + 1) + 1;
 
 
 /*int16_t get_version() {
@@ -705,19 +812,92 @@ GameVersion parse_version(std::string versionString) {
 }
 
 
+uint32_t get_save_checksum(const SaveImage& image) {
+    // FNV-1a
+    const uint8_t* bytes = (const uint8_t*)&image;
+    uint32_t hash = 2166136261u;
+
+    for (uint16_t i = 0; i < sizeof(SaveImage) - sizeof(image.checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+void flush_save() {
+    // Snapshot every changed record, to be written in one go
+    if (!saveDirty) {
+        return;
+    }
+
+    saveImage.magic = SAVE_IMAGE_MAGIC;
+    saveImage.format = SAVE_IMAGE_FORMAT;
+    saveImage.size = sizeof(SaveImage);
+    saveImage.checksum = get_save_checksum(saveImage);
+
+    if (!savePending) {
+        // Later flushes replace the snapshot, but don't delay the write any further
+        savePendingTimer = 0.0f;
+    }
+
+    pendingSaveImage = saveImage;
+    savePending = true;
+
+    saveDirty = 0;
+}
+
+void commit_save() {
+    if (savePending) {
+        write_save(pendingSaveImage, SAVE_IMAGE_SLOT);
+        savePending = false;
+    }
+}
+
+void update_save(float dt, bool quiet) {
+    if (savePending) {
+        savePendingTimer += dt;
+
+        if (quiet || savePendingTimer >= SAVE_WRITE_DELAY) {
+            commit_save();
+        }
+    }
+}
+
+// Writes everything straight away, for points where a stall won't be noticed (screen covered by the transition).
+// The 32blit can be switched off or sent back to the launcher at any time, so saves shouldn't be left waiting there.
+void save_now() {
+    flush_save();
+    commit_save();
+}
+
+enum class SaveStatus {
+    SAVED,
+    UNSAVED, // Records changed but not flushed yet
+    PENDING // Flushed, waiting to be written
+};
+
+// For the UI (e.g. a saving indicator), not used by the game yet
+SaveStatus get_save_status() {
+    if (savePending) {
+        return SaveStatus::PENDING;
+    }
+    else if (saveDirty) {
+        return SaveStatus::UNSAVED;
+    }
+
+    return SaveStatus::SAVED;
+}
+
 void save_game_data() {
-    // Write save data
-    write_save(gameSaveData);
+    saveDirty |= 1 << SAVE_RECORD_GAME;
 }
 
 void save_level_data(uint8_t playerID, uint8_t levelNumber) {
-    // Write level data
-    write_save(allLevelSaveData[playerID][levelNumber], (playerID * (BYTE_SIZE + 1)) + 1 + levelNumber + 1);
+    saveDirty |= 1 << (SAVE_RECORD_LEVEL + playerID * LEVEL_COUNT + levelNumber);
 }
 
 void save_player_data(uint8_t playerID) {
-    // Write level data
-    write_save(allPlayerSaveData[playerID], (playerID * (BYTE_SIZE + 1)) + 1);
+    saveDirty |= 1 << (SAVE_RECORD_PLAYER + playerID);
 }
 
 LevelSaveData load_level_data(uint8_t playerID, uint8_t levelNumber) {
@@ -771,6 +951,39 @@ void reset_save() {
         allLevelSaveData[1][i].time = 0.0f;
         save_level_data(1, i);
     }
+
+    flush_save();
+}
+
+bool load_save() {
+    SaveImage image;
+
+    if (read_save(image, SAVE_IMAGE_SLOT)) {
+        if (image.magic == SAVE_IMAGE_MAGIC && image.format == SAVE_IMAGE_FORMAT && image.size == sizeof(SaveImage) && image.checksum == get_save_checksum(image)) {
+            saveImage = image;
+            saveDirty = 0;
+            return true;
+        }
+
+        printf("Warning: Save image is corrupt or from an unknown format, ignoring it\n");
+    }
+
+    // Fall back to the old one-slot-per-record layout
+    for (uint8_t i = 0; i < 2; i++) {
+        allPlayerSaveData[i] = load_player_data(i);
+
+        for (uint8_t j = 0; j < LEVEL_COUNT; j++) {
+            allLevelSaveData[i][j] = load_level_data(i, j);
+        }
+    }
+
+    if (read_save(gameSaveData)) {
+        // Convert to the new format next time the save is flushed
+        saveDirty = SAVE_RECORDS_ALL;
+        return true;
+    }
+
+    return false;
 }
 
 
@@ -837,64 +1050,124 @@ protected:
 };
 ScreenShake shaker(SCREEN_SHAKE_SHAKINESS);
 
+// Optional work at each quality level (lowest first)
+const float qualityParticleScale[QUALITY_LEVELS] = { 0.25f, 0.5f, 0.75f, 1.0f };
+const float qualitySnowDensity[QUALITY_LEVELS] = { 0.25f, 0.5f, 0.75f, 1.0f };
+const uint8_t qualityParallaxAlpha[QUALITY_LEVELS] = { 0, 255, 192, 192 }; // 0 skips parallax, 255 avoids blending
+
+// Measures how long frames take and scales back optional effects when they go over budget
+class QualityGovernor {
+public:
+    QualityGovernor() {
+        level = QUALITY_LEVELS - 1;
+        averageFrameTime = 0;
+        slowFrames = fastFrames = 0;
+    }
+
+    void add_frame(uint32_t frameTime) {
+        // Smooth out single slow frames
+        averageFrameTime = (averageFrameTime * 7 + frameTime) / 8;
+
+        if (averageFrameTime > QUALITY_FRAME_BUDGET_US) {
+            fastFrames = 0;
+            slowFrames++;
+
+            if (slowFrames >= QUALITY_DOWN_FRAMES && level > 0) {
+                level--;
+                slowFrames = 0;
+            }
+        }
+        else if (averageFrameTime < QUALITY_FRAME_BUDGET_US * QUALITY_HEADROOM) {
+            slowFrames = 0;
+            fastFrames++;
+
+            if (fastFrames >= QUALITY_UP_FRAMES && level < QUALITY_LEVELS - 1) {
+                level++;
+                fastFrames = 0;
+            }
+        }
+        else {
+            slowFrames = fastFrames = 0;
+        }
+    }
+
+    uint8_t scale_particle_count(uint8_t count) {
+        return std::max(1, (int)(count * qualityParticleScale[level]));
+    }
+
+    uint8_t scale_snow_count(uint8_t count) {
+        return count * qualitySnowDensity[level];
+    }
+
+    uint8_t get_parallax_alpha() {
+        return qualityParallaxAlpha[level];
+    }
+
+protected:
+    uint8_t level;
+    uint32_t averageFrameTime;
+    uint8_t slowFrames;
+    uint16_t fastFrames;
+};
+QualityGovernor quality;
+
+// Time spent in update() since the last render(), for the quality governor
+uint32_t frameUpdateTime = 0;
+
 class Colour {
 public:
     uint8_t r, g, b, a;
 
-    Colour() {
-        r = g = b = a = 255;
+    // constexpr so that colour tables can be built at compile time
+    constexpr Colour() : r(255), g(255), b(255), a(255) {
+
     }
 
-    Colour(uint8_t r, uint8_t g, uint8_t b) {
-        this->r = r;
-        this->g = g;
-        this->b = b;
-        a = 255;
+    constexpr Colour(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b), a(255) {
+
     }
 
-    Colour(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-        this->r = r;
-        this->g = g;
-        this->b = b;
-        this->a = a;
+    constexpr Colour(uint8_t r, uint8_t g, uint8_t b, uint8_t a) : r(r), g(g), b(b), a(a) {
+
     }
 };
 
 // Particle colours
-const std::vector<Colour> playerDeathParticleColours[2] = {
+constexpr Colour playerDeathParticleColours[2][3] = {
     { Colour(255, 255, 242), Colour(255, 204, 181), Colour(178, 53, 53) },
     { Colour(255, 255, 242), Colour(178, 214, 96), Colour(37, 124, 73) }
 };
-const std::vector<Colour> enemyDeathParticleColours[5] = {
+constexpr Colour enemyDeathParticleColours[5][3] = {
     { Colour(255, 255, 242), Colour(184, 197, 216), Colour(25, 40, 102) },
     { Colour(255, 255, 242), Colour(255, 204, 181), Colour(165, 82, 139) },
     { Colour(255, 255, 242), Colour(255, 204, 181), Colour(229, 114, 57) },
     { Colour(255, 255, 242), Colour(204, 137, 124), Colour(127, 24, 75) },
     { Colour(255, 255, 242), Colour(145, 224, 204), Colour(53, 130, 130) }
 };
-const std::vector<Colour> bossDeathParticleColours[3] = {
+constexpr Colour bossDeathParticleColours[3][3] = {
     { Colour(255, 255, 242), Colour(184, 197, 216), Colour(25, 40, 102) },
     { Colour(255, 255, 242), Colour(255, 204, 181), Colour(165, 82, 139) },
     { Colour(255, 255, 242), Colour(184, 197, 216), Colour(25, 40, 102) }
 };
-const std::vector<Colour> levelTriggerParticleColours = { Colour(255, 255, 242), Colour(145, 224, 204), Colour(53, 130, 130) };
+constexpr Colour levelTriggerParticleColours[] = { Colour(255, 255, 242), Colour(145, 224, 204), Colour(53, 130, 130) };
 
-const std::vector<Colour> checkpointParticleColours[3] = {
+constexpr Colour checkpointParticleColours[3][2] = {
     { Colour(255, 255, 242), Colour(184, 197, 216) },
     { Colour(178, 53, 53), Colour(127, 24, 75) },
     { Colour(37, 124, 73), Colour(16, 84, 72) }
 };
 
-const std::vector<Colour> finishParticleColours = { Colour(37, 124, 73), Colour(16, 84, 72), Colour(10, 57, 71) };
+constexpr Colour finishParticleColours[] = { Colour(37, 124, 73), Colour(16, 84, 72), Colour(10, 57, 71) };
 
-const std::vector<Colour> slowPlayerParticleColours = { Colour(145, 224, 204), Colour(53, 130, 130) };//Colour(255, 255, 242), 
-const std::vector<Colour> repelPlayerParticleColours = { Colour(255, 235, 140), Colour(255, 199, 89) };
+constexpr Colour slowPlayerParticleColours[] = { Colour(145, 224, 204), Colour(53, 130, 130) };//Colour(255, 255, 242), 
+constexpr Colour repelPlayerParticleColours[] = { Colour(255, 235, 140), Colour(255, 199, 89) };
 
 const Colour inputSelectColour = Colour(255, 199, 89);
 const Colour hudBackground = Colour(7, 0, 14, 64);
 const Colour gameBackground = Colour(62, 106, 178);
 const Colour defaultWhite = Colour(255, 255, 242);
 Colour splashColour = Colour(7, 0, 14, 0);
+const Colour transitionColour = Colour(7, 0, 14); // colour of fully closed transition tile
 
 class Camera {
 public:
@@ -980,6 +1253,8 @@ public:
         colour = Colour(0, 0, 0);
 
         age = 0;
+        pendingDt = 0;
+        skippedUpdates = 0;
     }
 
     Particle(float xPosition, float yPosition, float xVelocity, float yVelocity, float particleGravityX, float particleGravityY, Colour particleColour) {
@@ -993,16 +1268,60 @@ public:
         colour = particleColour;
 
         age = 0;
+        pendingDt = 0;
+        skippedUpdates = 0;
+    }
+
+    bool is_on_screen(Camera camera) {
+        float screenX = SCREEN_MID_WIDTH + x - camera.x;
+        float screenY = SCREEN_MID_HEIGHT + y - camera.y;
+        return screenX >= 0 && screenX < SCREEN_WIDTH && screenY >= 0 && screenY < SCREEN_HEIGHT;
     }
 
     void render(Camera camera) {
+        if (!is_on_screen(camera)) {
+            return;
+        }
+
         screen.pen = Pen(colour.r, colour.g, colour.b, colour.a);
         screen.pixel(Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
     }
 
-    void update(float dt) {
-        age += dt;
-        colour.a = std::max(0.0f, colour.a - age * 10);
+    void update(float dt, Camera camera) {
+        uint8_t frames;
+        if (take_update_time(dt, frames, camera)) {
+            step(dt, frames);
+        }
+    }
+
+protected:
+    float pendingDt;
+    uint8_t skippedUpdates;
+
+    // Returns false if the update should be skipped because the particle is off-screen.
+    // Otherwise dt is set to the time since the last update which wasn't skipped, and frames to the number of updates it covers.
+    bool take_update_time(float& dt, uint8_t& frames, Camera camera) {
+        pendingDt += dt;
+        skippedUpdates++;
+
+        if (!is_on_screen(camera) && skippedUpdates < OFFSCREEN_PARTICLE_UPDATE_INTERVAL) {
+            return false;
+        }
+
+        dt = pendingDt;
+        frames = skippedUpdates;
+        pendingDt = 0;
+        skippedUpdates = 0;
+        return true;
+    }
+
+    void step(float dt, uint8_t frames) {
+        // Fade once per frame covered, so particles fade out at the same rate however often they are updated
+        float frameDt = dt / frames;
+        for (uint8_t i = 0; i < frames; i++) {
+            age += frameDt;
+            colour.a = std::max(0.0f, colour.a - age * 10);
+        }
 
         xVel += gravityX * dt;
         yVel += gravityY * dt;
@@ -1012,46 +1331,95 @@ public:
     }
 };
 
-class ImageParticle {
-public:
+struct SnowFlake {
+    // Position within the snow field (0..SNOW_FIELD_WIDTH, 0..SNOW_FIELD_HEIGHT)
     float x, y;
     float xVel, yVel;
-    float gravityX, gravityY;
     uint16_t id;
+    // Edge flakes are only shown inside the inner bounds, so snow thins out towards the edges
+    bool edge;
+};
 
-    ImageParticle() {
-        x = y = 0;
-        xVel = yVel = 0;
+// Camera-relative snow. The field is tiled across the world, so flakes stay put as the camera moves
+// and wrap around instead of being spawned and removed.
+class SnowField {
+public:
+    SnowField() {
+        count = 0;
+        minX = maxX = innerMinX = innerMaxX = 0.0f;
+    }
 
-        gravityX = 0;
-        gravityY = 0;
-        id = 0;
+    void clear() {
+        count = 0;
     }
 
-    ImageParticle(float xPosition, float yPosition, float xVelocity, float yVelocity, float particleGravityX, float particleGravityY, uint16_t tileID) {
-        x = xPosition;
-        y = yPosition;
-        xVel = xVelocity;
-        yVel = yVelocity;
+    // Bounds are world x positions, worked out once per level
+    void init(uint8_t flakeCount, float minXBound, float maxXBound, float innerMinXBound, float innerMaxXBound, uint8_t xVelRange) {
+        count = std::min(flakeCount, SNOW_FIELD_MAX_COUNT);
 
-        gravityX = particleGravityX;
-        gravityY = particleGravityY;
-        id = tileID;
-    }
+        minX = minXBound;
+        maxX = maxXBound;
+        innerMinX = innerMinXBound;
+        innerMaxX = innerMaxXBound;
 
-    void render(Camera camera) {
-        render_sprite(id, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
+        for (uint8_t i = 0; i < count; i++) {
+            flakes[i].x = rand() % SNOW_FIELD_WIDTH;
+            flakes[i].y = rand() % SNOW_FIELD_HEIGHT;
+            flakes[i].xVel = rand() % xVelRange - xVelRange / 2;
+            flakes[i].yVel = rand() % 5 + 8;
+            flakes[i].id = snowParticleImages[rand() % std::size(snowParticleImages)];
+            flakes[i].edge = rand() % 2 == 0;
+        }
     }
 
     void update(float dt) {
-        xVel += gravityX * dt;
-        yVel += gravityY * dt;
+        for (uint8_t i = 0; i < count; i++) {
+            flakes[i].x = wrap(flakes[i].x + flakes[i].xVel * dt, SNOW_FIELD_WIDTH);
+            flakes[i].y = wrap(flakes[i].y + flakes[i].yVel * dt, SNOW_FIELD_HEIGHT);
+        }
+    }
 
-        x += xVel * dt;
-        y += yVel * dt;
+    void render(Camera camera) {
+        // Top left of the field in world space
+        float left = camera.x - SCREEN_MID_WIDTH - SNOW_FIELD_MARGIN;
+        float top = camera.y - SCREEN_MID_HEIGHT - SNOW_FIELD_MARGIN;
+
+        // Show fewer flakes if frames are running slow
+        uint8_t visibleCount = quality.scale_snow_count(count);
+
+        for (uint8_t i = 0; i < visibleCount; i++) {
+            // Nearest copy of the flake inside the field around the camera
+            float x = left + wrap(flakes[i].x - left, SNOW_FIELD_WIDTH);
+            float y = top + wrap(flakes[i].y - top, SNOW_FIELD_HEIGHT);
+
+            if (x < minX || x > maxX || (flakes[i].edge && (x < innerMinX || x > innerMaxX))) {
+                continue;
+            }
+
+            Point point = Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y);
+
+            if (point.x <= -SPRITE_SIZE || point.x >= SCREEN_WIDTH || point.y <= -SPRITE_SIZE || point.y >= SCREEN_HEIGHT) {
+                // In the margin
+                continue;
+            }
+
+            render_sprite(flakes[i].id, point);
+        }
+    }
+
+protected:
+    static float wrap(float value, float size) {
+        value = std::fmod(value, size);
+        return value < 0 ? value + size : value;
     }
+
+    SnowFlake flakes[SNOW_FIELD_MAX_COUNT];
+    uint8_t count;
+
+    float minX, maxX;
+    float innerMinX, innerMaxX;
 };
-std::vector<ImageParticle> imageParticles;
+SnowField snowField;
 
 
 class BrownianParticle : public Particle {
@@ -1068,14 +1436,19 @@ public:
         this->speed = speed;
     }
 
-    void update(float dt) {
+    void update(float dt, Camera camera) {
+        uint8_t frames;
+        if (!take_update_time(dt, frames, camera)) {
+            return;
+        }
+
         angle += (rand() % (angleWiggle * 2 + 1)) - angleWiggle;
         angle %= 360;
 
         xVel = std::cos((float)angle) * speed;
         yVel = std::sin((float)angle) * speed;
 
-        Particle::update(dt);
+        step(dt, frames);
     }
 
 protected:
@@ -1086,9 +1459,12 @@ protected:
 
 
 
-std::vector<Particle> generate_particles(float x, float y, float gravityX, float gravityY, std::vector<Colour> colours, float speed, uint8_t count) {
+std::vector<Particle> generate_particles(float x, float y, float gravityX, float gravityY, Span<Colour> colours, float speed, uint8_t count) {
     std::vector<Particle> particles;
 
+    // Fewer particles if frames are running slow
+    count = quality.scale_particle_count(count);
+
     for (uint8_t i = 0; i < count; i++) {
         float angle = rand() % 360;
 
@@ -1101,70 +1477,191 @@ std::vector<Particle> generate_particles(float x, float y, float gravityX, float
     return particles;
 }
 
-BrownianParticle generate_brownian_particle(float x, float y, float gravityX, float gravityY, float speed, std::vector<Colour> colours, uint8_t wiggle) {
+BrownianParticle generate_brownian_particle(float x, float y, float gravityX, float gravityY, float speed, Span<Colour> colours, uint8_t wiggle) {
     uint16_t angle = rand() % 360;
 
     return BrownianParticle(x, y, angle, speed, gravityX, gravityY, colours[rand() % colours.size()], wiggle);
 }
 
 
-class Projectile {
+// Handle to an entity in an EntityStore.
+// Unlike an index, a handle keeps referring to the same entity when other entities are added or removed.
+struct EntityHandle {
+    uint16_t slot;
+    uint16_t generation;
+};
+
+const uint16_t ENTITY_INDEX_NONE = 0xFFFF;
+
+// Entity flags (stored in EntityStore::flags)
+const uint8_t ENTITY_FLAG_DEATH_PARTICLES = 1 << 0;
+const uint8_t ENTITY_FLAG_GRAVITY = 1 << 1;
+const uint8_t ENTITY_FLAG_HIT = 1 << 2;
+
+// Structure-of-arrays storage for lots of small entities (enemies, projectiles).
+// Hot data (position, velocity, health, flags) is kept in tightly packed arrays so that the update, render and collision passes
+// only pull in the data they use. Cold data (timers, type data etc) is kept in a separate array of Cold structs.
+// Entities are removed by swapping the last entity into their place, so indices aren't stable - use an EntityHandle to keep hold of an entity.
+template<typename Cold>
+class EntityStore {
 public:
-    float x, y;
-    float xVel, yVel;
-    uint16_t id;
-    uint8_t width;
+    // maxEntities of 0 means no limit, otherwise spawn() fails (returns an invalid handle) once the store is full
+    EntityStore(uint16_t maxEntities = 0) {
+        capacity = maxEntities;
 
-    Projectile() {
-        x = y = 0;
-        xVel = yVel = 0;
+        if (capacity) {
+            // Allocate everything up front so that spawning never needs to reallocate
+            x.reserve(capacity);
+            y.reserve(capacity);
+            xVel.reserve(capacity);
+            yVel.reserve(capacity);
+            health.reserve(capacity);
+            lastDirection.reserve(capacity);
+            flags.reserve(capacity);
+            cold.reserve(capacity);
 
-        id = 0;
+            slots.reserve(capacity);
+            slotIndices.reserve(capacity);
+            generations.reserve(capacity);
+            freeSlots.reserve(capacity);
+        }
+    }
 
-        gravity = false;
+    // Hot data
+    std::vector<float> x, y;
+    std::vector<float> xVel, yVel;
+    std::vector<uint8_t> health;
+    std::vector<uint8_t> lastDirection;
+    std::vector<uint8_t> flags;
 
-        width = SPRITE_HALF;
+    // Cold data
+    std::vector<Cold> cold;
+
+    uint16_t size() const {
+        return x.size();
     }
 
-    Projectile(float xPosition, float yPosition, float xVelocity, float yVelocity, uint16_t tileId, bool gravity=true, uint8_t rectWidth=SPRITE_HALF) {
-        x = xPosition;
-        y = yPosition;
-        xVel = xVelocity;
-        yVel = yVelocity;
-        id = tileId;
-        this->gravity = gravity;
-        width = rectWidth;
+    bool is_full() const {
+        return capacity && size() >= capacity;
     }
 
-    void update(float dt, ButtonStates buttonStates) {
-        if (gravity) {
-            // Update gravity
-            yVel += PROJECTILE_GRAVITY * dt;
-            yVel = std::min(yVel, (float)PROJECTILE_GRAVITY_MAX);
+    void clear() {
+        x.clear();
+        y.clear();
+        xVel.clear();
+        yVel.clear();
+        health.clear();
+        lastDirection.clear();
+        flags.clear();
+        cold.clear();
+
+        slots.clear();
+        slotIndices.clear();
+        generations.clear();
+        freeSlots.clear();
+    }
+
+    EntityHandle spawn(float xPosition, float yPosition, float xVelocity, float yVelocity, uint8_t startHealth, uint8_t entityFlags, const Cold& coldData) {
+        if (is_full()) {
+            return EntityHandle{ ENTITY_INDEX_NONE, 0 };
         }
 
-        // Move entity y
-        y += yVel * dt;
+        uint16_t slot;
+        if (freeSlots.size()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = generations.size();
+            slotIndices.push_back(0);
+            generations.push_back(0);
+        }
 
-        // Move entity x
-        x += xVel * dt;
+        slotIndices[slot] = size();
+        slots.push_back(slot);
+
+        x.push_back(xPosition);
+        y.push_back(yPosition);
+        xVel.push_back(xVelocity);
+        yVel.push_back(yVelocity);
+        health.push_back(startHealth);
+        lastDirection.push_back(1); // 1 = right, 0 = left
+        flags.push_back(entityFlags);
+        cold.push_back(coldData);
+
+        return EntityHandle{ slot, generations[slot] };
     }
 
-    void render(Camera camera) {
-        render_sprite(id, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
-        //screen.sprite(id, Point(SCREEN_MID_WIDTH + x - camera.x - SPRITE_QUARTER, SCREEN_MID_HEIGHT + y - camera.y - SPRITE_QUARTER));
-        //screen.rectangle(Rect(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y, 4, 4));
+    // Returns current index of entity, or ENTITY_INDEX_NONE if it has been removed
+    uint16_t index_of(EntityHandle handle) const {
+        if (handle.slot < generations.size() && generations[handle.slot] == handle.generation) {
+            return slotIndices[handle.slot];
+        }
+        return ENTITY_INDEX_NONE;
+    }
+
+    EntityHandle handle_of(uint16_t index) const {
+        return EntityHandle{ slots[index], generations[slots[index]] };
+    }
+
+    void remove(uint16_t index) {
+        uint16_t last = size() - 1;
+        uint16_t slot = slots[index];
+
+        if (index != last) {
+            // Move last entity into the gap
+            x[index] = x[last];
+            y[index] = y[last];
+            xVel[index] = xVel[last];
+            yVel[index] = yVel[last];
+            health[index] = health[last];
+            lastDirection[index] = lastDirection[last];
+            flags[index] = flags[last];
+            cold[index] = std::move(cold[last]);
+
+            slots[index] = slots[last];
+            slotIndices[slots[index]] = index;
+        }
+
+        x.pop_back();
+        y.pop_back();
+        xVel.pop_back();
+        yVel.pop_back();
+        health.pop_back();
+        lastDirection.pop_back();
+        flags.pop_back();
+        cold.pop_back();
+        slots.pop_back();
+
+        // Invalidate any handles to removed entity
+        generations[slot]++;
+        freeSlots.push_back(slot);
     }
 
-    bool is_colliding(float playerX, float playerY) {
-        return x + SPRITE_HALF + width / 2 > playerX && x + SPRITE_HALF - width / 2 < playerX + SPRITE_SIZE && y + SPRITE_HALF + width / 2 > playerY && y + SPRITE_HALF - width / 2 < playerY + SPRITE_SIZE;
+    // Removes all entities for which predicate(index) returns true, returns number removed
+    template<typename Predicate>
+    uint16_t remove_if(Predicate predicate) {
+        uint16_t removed = 0;
+
+        // Go backwards so that entities swapped into a gap have already been checked
+        for (uint16_t i = size(); i > 0; i--) {
+            if (predicate(i - 1)) {
+                remove(i - 1);
+                removed++;
+            }
+        }
+
+        return removed;
     }
 
 protected:
-    bool gravity;
-};
-std::vector<Projectile> projectiles;
+    uint16_t capacity;
 
+    std::vector<uint16_t> slots; // index -> slot
+    std::vector<uint16_t> slotIndices; // slot -> index
+    std::vector<uint16_t> generations; // incremented each time a slot is freed
+    std::vector<uint16_t> freeSlots;
+};
 
 
 class LevelObject {
@@ -1221,40 +1718,529 @@ std::vector<Tile> background;
 std::vector<Tile> platforms;
 std::vector<Tile> spikes;
 
-class ParallaxTile : public Tile {
+// Tile grid cell types, used by the flow fields and for quick "is there a block here" checks
+const uint8_t GRID_EMPTY = 0;
+const uint8_t GRID_SOLID = 1; // foreground
+const uint8_t GRID_PLATFORM = 2;
+
+// Flow field distances are in tiles, and stop at FLOW_FIELD_MAX_DISTANCE (anything further away is FLOW_FIELD_UNREACHABLE)
+const uint8_t FLOW_FIELD_MAX_DISTANCE = 254;
+const uint8_t FLOW_FIELD_UNREACHABLE = 255;
+
+// How far above/below an entity's feet to look when picking a direction from a flow field (enemies can jump about 2 tiles)
+const int8_t FLOW_FIELD_SAMPLE_ABOVE = 2;
+const int8_t FLOW_FIELD_SAMPLE_BELOW = 1;
+
+// Solid/platform tiles in the current level, built once in load_level
+class TileGrid {
 public:
-    ParallaxTile() : Tile() {
-        id = TILE_ID_EMPTY;
-        layer = 0;
+    uint16_t width, height;
+
+    TileGrid() {
+        width = height = 0;
     }
 
-    ParallaxTile(uint16_t xPosition, uint16_t yPosition, uint16_t tileID, uint8_t parallaxLayer) : Tile(xPosition, yPosition, tileID) {
-        id = tileID;
-        layer = parallaxLayer;
+    void build(uint16_t levelWidth, uint16_t levelHeight) {
+        width = levelWidth;
+        height = levelHeight;
+
+        cells.assign(width * height, GRID_EMPTY);
+
+        for (uint16_t i = 0; i < platforms.size(); i++) {
+            set(platforms[i].x / SPRITE_SIZE, platforms[i].y / SPRITE_SIZE, GRID_PLATFORM);
+        }
+
+        for (uint16_t i = 0; i < foreground.size(); i++) {
+            set(foreground[i].x / SPRITE_SIZE, foreground[i].y / SPRITE_SIZE, GRID_SOLID);
+        }
     }
 
-    void update(float dt, ButtonStates buttonStates) {
-        
+    uint8_t get(int16_t tileX, int16_t tileY) const {
+        if (tileX < 0 || tileY < 0 || tileX >= width || tileY >= height) {
+            return GRID_EMPTY;
+        }
+        return cells[tileY * width + tileX];
     }
 
-    void render(Camera camera)
-    {
-        //screen.sprite(id, Point(SCREEN_MID_WIDTH + x - (camera.x * parallaxFactorLayersX[layer]), SCREEN_MID_HEIGHT + y - (camera.y * parallaxFactorLayersY[layer])));
-        // Not shifting sprite to center seems to give better coverage of parallax
-        //screen.sprite(id, Point(x - (camera.x * parallaxFactorLayersX[layer]), y - (camera.y * parallaxFactorLayersY[layer])));
-        render_sprite(id, Point(x - (camera.x * parallaxFactorLayersX[layer]), y - (camera.y * parallaxFactorLayersY[layer])));
+    bool is_solid(int16_t tileX, int16_t tileY) const {
+        return get(tileX, tileY) == GRID_SOLID;
+    }
+
+    // Solid blocks and platforms can both be stood on
+    bool is_ground(int16_t tileX, int16_t tileY) const {
+        return get(tileX, tileY) != GRID_EMPTY;
     }
 
 protected:
-    uint16_t id;
-    uint8_t layer;
+    void set(uint16_t tileX, uint16_t tileY, uint8_t type) {
+        if (tileX < width && tileY < height) {
+            cells[tileY * width + tileX] = type;
+        }
+    }
+
+    std::vector<uint8_t> cells;
 };
-std::vector<ParallaxTile> parallax;
+TileGrid tileGrid;
 
+int16_t to_tile(float position) {
+    return (int16_t)std::floor(position / SPRITE_SIZE);
+}
 
-class Pickup : public LevelObject {
+// Distance map (in tiles, through non-solid tiles) towards a target.
+// It is only recalculated when the target moves into a different tile, and is then sampled by everything heading towards that target,
+// so the cost doesn't go up with the number of entities using it.
+class FlowField {
 public:
-    bool collected;
+    FlowField() {
+        targetX = targetY = -1;
+    }
+
+    void clear() {
+        distances.clear();
+        targetX = targetY = -1;
+    }
+
+    // Position is in pixels
+    void set_target(float x, float y) {
+        int16_t tileX = to_tile(x);
+        int16_t tileY = to_tile(y);
+
+        if (tileX != targetX || tileY != targetY || distances.size() != (uint32_t)tileGrid.width * tileGrid.height) {
+            targetX = tileX;
+            targetY = tileY;
+            calculate();
+        }
+    }
+
+    bool has_target(float x, float y) const {
+        return to_tile(x) == targetX && to_tile(y) == targetY;
+    }
+
+    uint8_t get_distance(int16_t tileX, int16_t tileY) const {
+        if (tileX < 0 || tileY < 0 || tileX >= tileGrid.width || tileY >= tileGrid.height || distances.size() == 0) {
+            return FLOW_FIELD_UNREACHABLE;
+        }
+        return distances[tileY * tileGrid.width + tileX];
+    }
+
+    // Returns 1 if heading right gets closer to the target, 0 if heading left does, or fallback if neither is better.
+    // feetX/feetY is the centre of the entity's lowest row of tiles, halfWidth is half of the entity's width (in pixels)
+    uint8_t get_direction(float feetX, float feetY, uint8_t halfWidth, uint8_t fallback) const {
+        int16_t tileY = to_tile(feetY);
+
+        uint8_t left = get_column_distance(to_tile(feetX - halfWidth - SPRITE_HALF), tileY);
+        uint8_t right = get_column_distance(to_tile(feetX + halfWidth + SPRITE_HALF), tileY);
+
+        if (left < right) {
+            return 0;
+        }
+        else if (right < left) {
+            return 1;
+        }
+        return fallback;
+    }
+
+protected:
+    uint8_t get_column_distance(int16_t tileX, int16_t tileY) const {
+        uint8_t best = FLOW_FIELD_UNREACHABLE;
+        for (int16_t y = tileY - FLOW_FIELD_SAMPLE_ABOVE; y <= tileY + FLOW_FIELD_SAMPLE_BELOW; y++) {
+            best = std::min(best, get_distance(tileX, y));
+        }
+        return best;
+    }
+
+    void calculate() {
+        uint16_t width = tileGrid.width;
+        uint16_t height = tileGrid.height;
+
+        distances.assign(width * height, FLOW_FIELD_UNREACHABLE);
+
+        if (targetX < 0 || targetY < 0 || targetX >= width || targetY >= height) {
+            return;
+        }
+
+        // Breadth first search out from the target (queue is shared, only one field is calculated at a time)
+        queue.clear();
+        queue.push_back(targetY * width + targetX);
+        distances[queue[0]] = 0;
+
+        for (uint32_t head = 0; head < queue.size(); head++) {
+            uint32_t index = queue[head];
+            uint8_t distance = distances[index];
+
+            if (distance >= FLOW_FIELD_MAX_DISTANCE) {
+                continue;
+            }
+
+            uint16_t tileX = index % width;
+            uint16_t tileY = index / width;
+
+            if (tileX > 0) {
+                visit(index - 1, distance + 1);
+            }
+            if (tileX < width - 1) {
+                visit(index + 1, distance + 1);
+            }
+            if (tileY > 0) {
+                visit(index - width, distance + 1);
+            }
+            if (tileY < height - 1) {
+                visit(index + width, distance + 1);
+            }
+        }
+    }
+
+    void visit(uint32_t index, uint8_t distance) {
+        if (distances[index] == FLOW_FIELD_UNREACHABLE && !tileGrid.is_solid(index % tileGrid.width, index / tileGrid.width)) {
+            distances[index] = distance;
+            queue.push_back(index);
+        }
+    }
+
+    int16_t targetX, targetY;
+
+    std::vector<uint8_t> distances;
+
+    static std::vector<uint32_t> queue;
+};
+std::vector<uint32_t> FlowField::queue;
+
+// Shared by all enemies chasing the player
+FlowField playerFlowField;
+
+// Fields leading back to each boss spawn, kept out of Boss so that bosses stay cheap to copy
+std::vector<FlowField> spawnFlowFields;
+
+// Returns the field leading to the given spawn position (in pixels), adding it if no boss has used that spawn yet
+FlowField& get_spawn_flow_field(float x, float y) {
+    for (uint8_t i = 0; i < spawnFlowFields.size(); i++) {
+        if (spawnFlowFields[i].has_target(x, y)) {
+            return spawnFlowFields[i];
+        }
+    }
+
+    spawnFlowFields.push_back(FlowField());
+    spawnFlowFields.back().set_target(x, y);
+    return spawnFlowFields.back();
+}
+
+
+// Cold projectile data
+struct ProjectileData {
+    uint16_t id;
+    uint8_t width;
+};
+// Fixed size, so that boss rapid-fire can't keep growing it
+EntityStore<ProjectileData> projectiles(MAX_PROJECTILES);
+
+void spawn_projectile(float x, float y, float xVel, float yVel, uint16_t tileId, bool gravity = true, uint8_t rectWidth = SPRITE_HALF) {
+    projectiles.spawn(x, y, xVel, yVel, 1, gravity ? ENTITY_FLAG_GRAVITY : 0, ProjectileData{ tileId, rectWidth });
+}
+
+// Projectiles are stopped by foreground tiles
+bool projectile_hit_wall(uint16_t i) {
+    return tileGrid.is_solid(to_tile(projectiles.x[i] + SPRITE_HALF), to_tile(projectiles.y[i] + SPRITE_HALF));
+}
+
+bool projectile_off_screen(uint16_t i, float cameraX, float cameraY) {
+    float xOffset = projectiles.x[i] + SPRITE_HALF - cameraX;
+    float yOffset = projectiles.y[i] + SPRITE_HALF - cameraY;
+
+    if (std::abs(xOffset) > SCREEN_MID_WIDTH + PROJECTILE_CULL_MARGIN || yOffset > SCREEN_MID_HEIGHT + PROJECTILE_CULL_MARGIN) {
+        return true;
+    }
+
+    // Projectiles affected by gravity will come back down if they go above the screen
+    return !(projectiles.flags[i] & ENTITY_FLAG_GRAVITY) && yOffset < -(SCREEN_MID_HEIGHT + PROJECTILE_CULL_MARGIN);
+}
+
+bool projectile_colliding(uint16_t i, float playerX, float playerY) {
+    float x = projectiles.x[i];
+    float y = projectiles.y[i];
+    uint8_t width = projectiles.cold[i].width;
+    return x + SPRITE_HALF + width / 2 > playerX && x + SPRITE_HALF - width / 2 < playerX + SPRITE_SIZE && y + SPRITE_HALF + width / 2 > playerY && y + SPRITE_HALF - width / 2 < playerY + SPRITE_SIZE;
+}
+
+class ParallaxTile : public Tile {
+public:
+    ParallaxTile() : Tile() {
+        id = TILE_ID_EMPTY;
+        layer = 0;
+    }
+
+    ParallaxTile(uint16_t xPosition, uint16_t yPosition, uint16_t tileID, uint8_t parallaxLayer) : Tile(xPosition, yPosition, tileID) {
+        id = tileID;
+        layer = parallaxLayer;
+    }
+
+    void update(float dt, ButtonStates buttonStates) {
+        
+    }
+
+    void render(Camera camera)
+    {
+        //screen.sprite(id, Point(SCREEN_MID_WIDTH + x - (camera.x * parallaxFactorLayersX[layer]), SCREEN_MID_HEIGHT + y - (camera.y * parallaxFactorLayersY[layer])));
+        // Not shifting sprite to center seems to give better coverage of parallax
+        //screen.sprite(id, Point(x - (camera.x * parallaxFactorLayersX[layer]), y - (camera.y * parallaxFactorLayersY[layer])));
+        render_sprite(id, Point(x - (camera.x * parallaxFactorLayersX[layer]), y - (camera.y * parallaxFactorLayersY[layer])));
+    }
+
+protected:
+    uint16_t id;
+    uint8_t layer;
+};
+std::vector<ParallaxTile> parallax;
+
+#ifdef PREBLEND_PARALLAX
+// Each strip covers the screen plus a tile, and wraps around as the layer scrolls
+const uint8_t PARALLAX_STRIP_COLUMNS = SCREEN_WIDTH / SPRITE_SIZE + 1;
+const uint8_t PARALLAX_STRIP_ROWS = SCREEN_HEIGHT / SPRITE_SIZE + 1;
+const uint16_t PARALLAX_STRIP_WIDTH = PARALLAX_STRIP_COLUMNS * SPRITE_SIZE;
+const uint16_t PARALLAX_STRIP_HEIGHT = PARALLAX_STRIP_ROWS * SPRITE_SIZE;
+
+// Floor division, so that negative scroll positions land in the right tile
+int32_t floor_div(int32_t a, int32_t b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+int32_t wrap_index(int32_t a, int32_t b) {
+    return a - floor_div(a, b) * b;
+}
+
+// One parallax layer, pre-composited into a paletted off-screen strip.
+// The strip's palette is the sprite palette with the layer alpha already applied, so drawing it is a single blit.
+// Only the tile columns/rows which scroll into view are copied in each frame.
+class ParallaxStrip {
+public:
+    ParallaxStrip() : pixels(PARALLAX_STRIP_WIDTH * PARALLAX_STRIP_HEIGHT), surface(pixels.data(), PixelFormat::P, Size(PARALLAX_STRIP_WIDTH, PARALLAX_STRIP_HEIGHT)), filledTiles(), rowTileCount() {
+        tiles = nullptr;
+        width = height = 0;
+        factorX = factorY = 0.0f;
+        valid = false;
+        empty = true;
+        paletteAlpha = 0;
+        transparentIndex = 0;
+    }
+
+    // tileData points at the layer in the level asset (stays in flash)
+    void load(const uint16_t* tileData, uint16_t levelWidth, uint16_t levelHeight, float parallaxFactorX, float parallaxFactorY) {
+        tiles = tileData;
+        width = levelWidth;
+        height = levelHeight;
+        factorX = parallaxFactorX;
+        factorY = parallaxFactorY;
+        valid = false;
+
+        // Menu levels don't have any parallax, so there's nothing to draw at all
+        empty = true;
+        for (uint32_t i = 0; i < (uint32_t)width * height; i++) {
+            if (tiles[i] != TILE_ID_EMPTY) {
+                empty = false;
+                break;
+            }
+        }
+    }
+
+    // Returns false if the sprite sheet can't be used this way, so the caller can fall back to drawing sprites
+    bool render(Camera camera, uint8_t alpha) {
+        if (!tiles || !screen.sprites || screen.sprites->format != PixelFormat::P || !screen.sprites->palette) {
+            return false;
+        }
+
+        if (empty) {
+            return true;
+        }
+
+        if (paletteAlpha != alpha || !valid) {
+            if (!update_palette(alpha)) {
+                return false;
+            }
+        }
+
+        // Top left of the view in layer space (matches ParallaxTile::render)
+        int32_t scrollX = std::floor(camera.x * factorX);
+        int32_t scrollY = std::floor(camera.y * factorY);
+
+        scroll_to(floor_div(scrollX, SPRITE_SIZE), floor_div(scrollY, SPRITE_SIZE));
+
+        screen.alpha = 255;
+
+        // Layers are mostly empty, so only blit runs of filled tiles (split where the strip wraps).
+        // Anything hanging off the screen is clipped by blit.
+        for (int32_t row = firstRow; row < firstRow + PARALLAX_STRIP_ROWS; row++) {
+            uint8_t stripRow = wrap_index(row, PARALLAX_STRIP_ROWS);
+
+            if (!rowTileCount[stripRow]) {
+                continue;
+            }
+
+            int32_t runStart = 0;
+            uint8_t runLength = 0;
+
+            for (int32_t column = firstColumn; column <= firstColumn + PARALLAX_STRIP_COLUMNS; column++) {
+                uint8_t stripColumn = wrap_index(column, PARALLAX_STRIP_COLUMNS);
+                bool filled = column < firstColumn + PARALLAX_STRIP_COLUMNS && filledTiles[stripRow][stripColumn];
+
+                if (runLength && (!filled || stripColumn == 0)) {
+                    screen.blit(&surface, Rect(wrap_index(runStart, PARALLAX_STRIP_COLUMNS) * SPRITE_SIZE, stripRow * SPRITE_SIZE, runLength * SPRITE_SIZE, SPRITE_SIZE), Point(runStart * SPRITE_SIZE - scrollX, row * SPRITE_SIZE - scrollY));
+                    runLength = 0;
+                }
+
+                if (filled) {
+                    if (!runLength) {
+                        runStart = column;
+                    }
+                    runLength++;
+                }
+            }
+        }
+
+        return true;
+    }
+
+protected:
+    bool update_palette(uint8_t alpha) {
+        Pen* spritePalette = screen.sprites->palette;
+
+        // Cleared pixels use the sprite sheet's transparent colour
+        bool foundTransparent = false;
+
+        for (uint16_t i = 0; i < 256; i++) {
+            palette[i] = spritePalette[i];
+            palette[i].a = spritePalette[i].a * alpha / 255;
+
+            if (!foundTransparent && spritePalette[i].a == 0) {
+                transparentIndex = i;
+                foundTransparent = true;
+            }
+        }
+
+        if (!foundTransparent) {
+            return false;
+        }
+
+        surface.palette = palette;
+
+        if (!valid) {
+            // Redraw everything with the new transparent colour
+            firstColumn = firstRow = 0;
+            redraw_all();
+            valid = true;
+        }
+
+        paletteAlpha = alpha;
+        return true;
+    }
+
+    void scroll_to(int32_t column, int32_t row) {
+        if (std::abs(column - firstColumn) >= PARALLAX_STRIP_COLUMNS || std::abs(row - firstRow) >= PARALLAX_STRIP_ROWS) {
+            firstColumn = column;
+            firstRow = row;
+            redraw_all();
+            return;
+        }
+
+        // Copy in the columns and rows which have come into view
+        while (firstColumn < column) {
+            firstColumn++;
+            draw_column(firstColumn + PARALLAX_STRIP_COLUMNS - 1);
+        }
+        while (firstColumn > column) {
+            firstColumn--;
+            draw_column(firstColumn);
+        }
+        while (firstRow < row) {
+            firstRow++;
+            draw_row(firstRow + PARALLAX_STRIP_ROWS - 1);
+        }
+        while (firstRow > row) {
+            firstRow--;
+            draw_row(firstRow);
+        }
+    }
+
+    void redraw_all() {
+        for (int32_t column = firstColumn; column < firstColumn + PARALLAX_STRIP_COLUMNS; column++) {
+            draw_column(column);
+        }
+    }
+
+    void draw_column(int32_t column) {
+        for (int32_t row = firstRow; row < firstRow + PARALLAX_STRIP_ROWS; row++) {
+            draw_tile(column, row);
+        }
+    }
+
+    void draw_row(int32_t row) {
+        for (int32_t column = firstColumn; column < firstColumn + PARALLAX_STRIP_COLUMNS; column++) {
+            draw_tile(column, row);
+        }
+    }
+
+    void draw_tile(int32_t column, int32_t row) {
+        uint8_t stripRow = wrap_index(row, PARALLAX_STRIP_ROWS);
+        uint8_t stripColumn = wrap_index(column, PARALLAX_STRIP_COLUMNS);
+        uint8_t* destination = pixels.data() + stripRow * SPRITE_SIZE * PARALLAX_STRIP_WIDTH + stripColumn * SPRITE_SIZE;
+
+        uint16_t id = TILE_ID_EMPTY;
+        if (column >= 0 && row >= 0 && column < width && row < height) {
+            id = tiles[row * width + column];
+        }
+
+        // Keep track of which tiles are filled, so that render can skip the rest
+        bool filled = id != TILE_ID_EMPTY;
+        if (filledTiles[stripRow][stripColumn] != filled) {
+            filledTiles[stripRow][stripColumn] = filled;
+
+            if (filled) {
+                rowTileCount[stripRow]++;
+            }
+            else {
+                rowTileCount[stripRow]--;
+            }
+        }
+
+        if (id == TILE_ID_EMPTY) {
+            for (uint8_t y = 0; y < SPRITE_SIZE; y++) {
+                std::fill(destination + y * PARALLAX_STRIP_WIDTH, destination + y * PARALLAX_STRIP_WIDTH + SPRITE_SIZE, transparentIndex);
+            }
+            return;
+        }
+
+        // Copy the palette indices straight from the sprite sheet
+        Surface* sprites = screen.sprites;
+        uint16_t spritesPerRow = sprites->bounds.w / SPRITE_SIZE;
+        const uint8_t* source = sprites->data + (id / spritesPerRow) * SPRITE_SIZE * sprites->bounds.w + (id % spritesPerRow) * SPRITE_SIZE;
+
+        for (uint8_t y = 0; y < SPRITE_SIZE; y++) {
+            std::copy(source + y * sprites->bounds.w, source + y * sprites->bounds.w + SPRITE_SIZE, destination + y * PARALLAX_STRIP_WIDTH);
+        }
+    }
+
+    std::vector<uint8_t> pixels;
+    Surface surface;
+    Pen palette[256];
+
+    const uint16_t* tiles;
+    uint16_t width, height;
+    float factorX, factorY;
+
+    int32_t firstColumn, firstRow;
+    bool valid;
+    bool empty;
+    uint8_t paletteAlpha;
+    uint8_t transparentIndex;
+
+    bool filledTiles[PARALLAX_STRIP_ROWS][PARALLAX_STRIP_COLUMNS];
+    uint8_t rowTileCount[PARALLAX_STRIP_ROWS];
+};
+ParallaxStrip parallaxStrips[2];
+#endif // PREBLEND_PARALLAX
+
+
+class Pickup : public LevelObject {
+public:
+    bool collected;
 
     Pickup() : LevelObject() {
         collected = false;
@@ -1277,11 +2263,13 @@ public:
     AnimatedPickup() : Pickup() {
         animationTimer = 0;
         currentFrame = 0;
+        frameChanged = false;
     }
 
-    AnimatedPickup(uint16_t xPosition, uint16_t yPosition, std::vector<uint16_t> animationFrames) : Pickup(xPosition, yPosition) {
+    AnimatedPickup(uint16_t xPosition, uint16_t yPosition, Span<uint16_t> animationFrames) : Pickup(xPosition, yPosition) {
         animationTimer = 0;
         currentFrame = 0;
+        frameChanged = false;
 
         frames = animationFrames;
     }
@@ -1293,9 +2281,17 @@ public:
             animationTimer -= FRAME_LENGTH;
             currentFrame++;
             currentFrame %= frames.size();
+            frameChanged = true;
         }
     }
 
+    // Returns true (once) if the frame shown has changed since the last call
+    bool take_frame_changed() {
+        bool changed = frameChanged && !collected;
+        frameChanged = false;
+        return changed;
+    }
+
     void render(Camera camera) {
         if (!collected) {
             //screen.sprite(frames[currentFrame], Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
@@ -1305,8 +2301,9 @@ public:
 
 protected:
     float animationTimer;
-    std::vector<uint16_t> frames;
+    Span<uint16_t> frames;
     uint16_t currentFrame;
+    bool frameChanged;
 };
 
 class Coin : public AnimatedPickup {
@@ -1315,7 +2312,7 @@ public:
 
     }
 
-    Coin(uint16_t xPosition, uint16_t yPosition, std::vector<uint16_t> animationFrames) : AnimatedPickup(xPosition, yPosition, animationFrames) {
+    Coin(uint16_t xPosition, uint16_t yPosition, Span<uint16_t> animationFrames) : AnimatedPickup(xPosition, yPosition, animationFrames) {
 
     }
 
@@ -1341,7 +2338,7 @@ public:
         particleTimer = 0.0f;
     }
 
-    Finish(uint16_t xPosition, uint16_t yPosition, std::vector<uint16_t> animationFrames) : AnimatedPickup(xPosition, yPosition, animationFrames) {
+    Finish(uint16_t xPosition, uint16_t yPosition, Span<uint16_t> animationFrames) : AnimatedPickup(xPosition, yPosition, animationFrames) {
         particleTimer = 0.0f;
     }
 
@@ -1355,7 +2352,7 @@ public:
         }*/
 
         for (uint8_t i = 0; i < particles.size(); i++) {
-            particles[i].update(dt);
+            particles[i].update(dt, camera);
         }
 
         // Remove any particles which are too old
@@ -1373,51 +2370,34 @@ public:
 };
 Finish finish;
 
-class AnimatedTransition {
+// Screen transition.
+// The screen is covered by a grid of tiles which all animate closed/open from a single timer, rather than each tile keeping its own state.
+// Tiles can optionally be delayed by a set time per column, to wipe across the screen.
+class ScreenTransition {
 public:
-    uint8_t x, y;
-    float closedTimer;
-
-    AnimatedTransition() {
-        animationTimer = 0;
-        currentFrame = 0;
-
+    ScreenTransition() {
         state = TransitionState::OPEN;
-        x = y = 0;
+        timer = 0;
         closedTimer = 0;
+        columnDelay = 0;
     }
 
-    AnimatedTransition(uint16_t xPosition, uint16_t yPosition, std::vector<uint16_t> open, std::vector<uint16_t> close) {
-        animationTimer = 0;
-        currentFrame = 0;
-
-        openingFrames = open;
-        closingFrames = close;
-        state = TransitionState::OPEN;
-        x = xPosition;
-        y = yPosition;
-
-        closedTimer = 0;
+    // Delay (in seconds) between each column starting to animate, 0 animates every tile at once
+    void set_column_delay(float delay) {
+        columnDelay = delay;
     }
 
-    void update(float dt, ButtonStates buttonStates) {
+    void update(float dt) {
         if (state == TransitionState::CLOSING || state == TransitionState::OPENING) {
-            animationTimer += dt;
-
-            if (animationTimer >= TRANSITION_FRAME_LENGTH) {
-                animationTimer -= TRANSITION_FRAME_LENGTH;
-                currentFrame++;
+            timer += dt;
 
+            if (timer >= get_duration()) {
                 if (state == TransitionState::CLOSING) {
-                    if (currentFrame == closingFrames.size()) {
-                        state = TransitionState::CLOSED;
-                        closedTimer = 0;
-                    }
+                    state = TransitionState::CLOSED;
+                    closedTimer = 0;
                 }
                 else {
-                    if (currentFrame == openingFrames.size()) {
-                        state = TransitionState::OPEN;
-                    }
+                    state = TransitionState::OPEN;
                 }
             }
         }
@@ -1429,34 +2409,59 @@ public:
         }
     }
 
-    void render(Camera camera) {
-        if (state == TransitionState::CLOSING) {
-            //screen.sprite(closingFrames[currentFrame], Point(x, y));
-            render_sprite(closingFrames[currentFrame], Point(x, y));
-        }
-        else if (state == TransitionState::OPENING) {
-            //screen.sprite(openingFrames[currentFrame], Point(x, y), SpriteTransform::HORIZONTAL);
-            render_sprite(openingFrames[currentFrame], Point(x, y), SpriteTransform::HORIZONTAL);
+    void render() {
+        if (state == TransitionState::OPEN) {
+            // Don't do anything
+            return;
         }
-        else if (state == TransitionState::CLOSED || state == TransitionState::READY_TO_OPEN) {
-            //screen.sprite(closingFrames[closingFrames.size() - 1], Point(x, y));
-            render_sprite(closingFrames[closingFrames.size() - 1], Point(x, y));
+
+        screen.pen = Pen(transitionColour.r, transitionColour.g, transitionColour.b);
+
+        if (state == TransitionState::CLOSED || state == TransitionState::READY_TO_OPEN) {
+            screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
+            return;
         }
-        else if (state == TransitionState::OPEN) {
-            // Don't do anything
+
+        // Runs of fully closed columns are drawn as one rectangle, the rest are drawn tile by tile
+        uint8_t spanStart = TRANSITION_COLUMNS;
+
+        for (uint8_t column = 0; column <= TRANSITION_COLUMNS; column++) {
+            int16_t frame = column < TRANSITION_COLUMNS ? get_column_frame(column) : 0;
+            bool closed = column < TRANSITION_COLUMNS && is_frame_closed(frame);
+
+            if (closed) {
+                if (spanStart == TRANSITION_COLUMNS) {
+                    spanStart = column;
+                }
+                continue;
+            }
+
+            if (spanStart != TRANSITION_COLUMNS) {
+                screen.rectangle(Rect(spanStart * SPRITE_SIZE, 0, (column - spanStart) * SPRITE_SIZE, SCREEN_HEIGHT));
+                spanStart = TRANSITION_COLUMNS;
+            }
+
+            if (column < TRANSITION_COLUMNS && frame >= 0 && frame < (int16_t)std::size(transitionFramesClose)) {
+                for (uint8_t row = 0; row < TRANSITION_ROWS; row++) {
+                    if (state == TransitionState::CLOSING) {
+                        render_sprite(transitionFramesClose[frame], Point(column * SPRITE_SIZE, row * SPRITE_SIZE));
+                    }
+                    else {
+                        render_sprite(transitionFramesOpen[frame], Point(column * SPRITE_SIZE, row * SPRITE_SIZE), SpriteTransform::HORIZONTAL);
+                    }
+                }
+            }
         }
     }
 
     void close() {
         state = TransitionState::CLOSING;
-        animationTimer = 0;
-        currentFrame = 0;
+        timer = 0;
     }
 
     void open() {
         state = TransitionState::OPENING;
-        animationTimer = 0;
-        currentFrame = 0;
+        timer = 0;
     }
 
     bool is_closed() {
@@ -1480,11 +2485,33 @@ protected:
         READY_TO_OPEN
     } state;
 
-    float animationTimer;
-    std::vector<uint16_t> openingFrames, closingFrames;
-    uint16_t currentFrame;
+    float timer;
+    float closedTimer;
+    float columnDelay;
+
+    float get_duration() {
+        return std::size(transitionFramesClose) * TRANSITION_FRAME_LENGTH + (TRANSITION_COLUMNS - 1) * columnDelay;
+    }
+
+    // Frame the column is on (negative if it hasn't started yet, >= frame count if it has finished)
+    int16_t get_column_frame(uint8_t column) {
+        return (int16_t)std::floor((timer - column * columnDelay) / TRANSITION_FRAME_LENGTH);
+    }
+
+    bool is_frame_closed(int16_t frame) {
+        int16_t frameCount = std::size(transitionFramesClose);
+
+        if (state == TransitionState::CLOSING) {
+            // Last closing frame is solid
+            return frame >= frameCount - 1;
+        }
+        else {
+            // Columns which haven't started opening yet are still closed
+            return frame < 0;
+        }
+    }
 };
-AnimatedTransition transition[SCREEN_TILE_SIZE];
+ScreenTransition transition;
 
 
 
@@ -1502,6 +2529,7 @@ public:
         generateParticles = false;
         animationTimer = 0.0f;
         currentFrame = 0;
+        frameChanged = false;
     }
 
     Checkpoint(uint16_t xPosition, uint16_t yPosition) {
@@ -1512,6 +2540,7 @@ public:
         generateParticles = false;
         animationTimer = 0.0f;
         currentFrame = 0;
+        frameChanged = false;
     }
 
     void update(float dt) {
@@ -1521,6 +2550,7 @@ public:
             animationTimer -= CHECKPOINT_FRAME_LENGTH;
             currentFrame++;
             currentFrame %= CHECKPOINT_FRAMES;
+            frameChanged = true;
         }
 
         if (generateParticles) {
@@ -1529,7 +2559,7 @@ public:
             }
             else {
                 for (uint8_t i = 0; i < particles.size(); i++) {
-                    particles[i].update(dt);
+                    particles[i].update(dt, camera);
                 }
 
                 // Remove any particles which are too old
@@ -1552,6 +2582,13 @@ public:
         }
     }
 
+    // Returns true (once) if the frame shown has changed since the last call
+    bool take_frame_changed() {
+        bool changed = frameChanged && x && y;
+        frameChanged = false;
+        return changed;
+    }
+
     bool activate(uint8_t c) {
         if (colour) {
             return false;
@@ -1570,6 +2607,7 @@ public:
 protected:
     float animationTimer;
     uint16_t currentFrame;
+    bool frameChanged;
 } checkpoint;
 
 
@@ -1621,7 +2659,7 @@ public:
                 }
                 else {
                     for (uint8_t i = 0; i < particles.size(); i++) {
-                        particles[i].update(dt);
+                        particles[i].update(dt, camera);
                     }
 
                     // Remove any particles which are too old
@@ -1667,14 +2705,53 @@ bool level_trigger_sort_min_x(const LevelTrigger& a, const LevelTrigger& b) {
 }
 
 
+// Shared checks for entities which are one tile in size
 
-class Entity {
-public:
-    float x, y;
-    float xVel, yVel;
-    uint8_t health;
-    bool locked;
-    std::vector<Particle> particles;
+bool entity_colliding(float x, float y, Tile tile) {
+    // Replace use of this with actual code?
+    return (tile.x + SPRITE_SIZE > x + 1 && tile.x < x + SPRITE_SIZE - 1 && tile.y + SPRITE_SIZE > y && tile.y < y + SPRITE_SIZE);
+}
+
+bool entity_on_block(float x, float y) {
+    // Is entity on a tile?
+    for (uint16_t i = 0; i < foreground.size(); i++) {
+        if (y + SPRITE_SIZE == foreground[i].y && foreground[i].x + SPRITE_SIZE - 1 > x && foreground[i].x + 1 < x + SPRITE_SIZE) {
+            // On top of block
+            return true;
+        }
+    }
+
+    // Is entity on a platform?
+    for (uint16_t i = 0; i < platforms.size(); i++) {
+        if (y + SPRITE_SIZE == platforms[i].y && platforms[i].x + SPRITE_SIZE - 1 > x && platforms[i].x + 1 < x + SPRITE_SIZE) {
+            // On top of block
+            return true;
+        }
+    }
+
+    // Is entity on a locked LevelTrigger?
+    for (uint16_t i = 0; i < levelTriggers.size(); i++) {
+        if (y + SPRITE_SIZE == levelTriggers[i].y && levelTriggers[i].x + SPRITE_SIZE - 1 > x && levelTriggers[i].x + 1 < x + SPRITE_SIZE) {
+            // On top of block
+            if (allPlayerSaveData[playerSelected].levelReached < levelTriggers[i].levelNumber) {
+                // LevelTrigger is locked
+                return true;
+            }
+        }
+    }
+
+    // Not on a block
+    return false;
+}
+
+
+class Entity {
+public:
+    float x, y;
+    float xVel, yVel;
+    uint8_t health;
+    bool locked;
+    std::vector<Particle> particles;
     uint8_t lastDirection;
     float jumpCooldown;
 
@@ -1717,62 +2794,6 @@ public:
 
     }
 
-    void update_collisions() {
-        if (!locked) {
-            // Update gravity
-            yVel += GRAVITY * dt;
-            yVel = std::min(yVel, (float)GRAVITY_MAX);
-
-            // Move entity y
-            y += yVel * dt;
-
-            // Here check collisions...
-            for (uint16_t i = 0; i < foreground.size(); i++) {
-                if (colliding(foreground[i])) {
-                    if (yVel > 0) {
-                        // Collided from top
-                        y = foreground[i].y - SPRITE_SIZE;
-                    }
-                    else if (yVel < 0) {
-                        // Collided from bottom
-                        y = foreground[i].y + SPRITE_SIZE;
-                    }
-                    yVel = 0;
-                }
-            }
-
-            // Platforms may need work
-            for (uint16_t i = 0; i < platforms.size(); i++) {
-                handle_platform_collisions(platforms[i]);
-            }
-
-            // Move entity x
-            x += xVel * dt;
-
-            // Here check collisions...
-            for (uint16_t i = 0; i < foreground.size(); i++) {
-                if (colliding(foreground[i])) {
-                    if (xVel > 0) {
-                        // Collided from left
-                        x = foreground[i].x - SPRITE_SIZE + 1;
-                    }
-                    else if (xVel < 0) {
-                        // Collided from right
-                        x = foreground[i].x + SPRITE_SIZE - 1;
-                    }
-                    xVel = 0;
-                }
-            }
-
-            if (xVel > 0) {
-                lastDirection = 1;
-            }
-            else if (xVel < 0) {
-                lastDirection = 0;
-            }
-        }
-    }
-
     void jump(float jumpVel, float cooldown) {
         // Jump
         yVel = -jumpVel;
@@ -1780,35 +2801,7 @@ public:
     }
 
     bool is_on_block() {
-        // Is entity on a tile?
-        for (uint16_t i = 0; i < foreground.size(); i++) {
-            if (y + SPRITE_SIZE == foreground[i].y && foreground[i].x + SPRITE_SIZE - 1 > x && foreground[i].x + 1 < x + SPRITE_SIZE) {
-                // On top of block
-                return true;
-            }
-        }
-
-        // Is entity on a platform?
-        for (uint16_t i = 0; i < platforms.size(); i++) {
-            if (y + SPRITE_SIZE == platforms[i].y && platforms[i].x + SPRITE_SIZE - 1 > x && platforms[i].x + 1 < x + SPRITE_SIZE) {
-                // On top of block
-                return true;
-            }
-        }
-
-        // Is entity on a locked LevelTrigger?
-        for (uint16_t i = 0; i < levelTriggers.size(); i++) {
-            if (y + SPRITE_SIZE == levelTriggers[i].y && levelTriggers[i].x + SPRITE_SIZE - 1 > x && levelTriggers[i].x + 1 < x + SPRITE_SIZE) {
-                // On top of block
-                if (allPlayerSaveData[playerSelected].levelReached < levelTriggers[i].levelNumber) {
-                    // LevelTrigger is locked
-                    return true;
-                }
-            }
-        }
-
-        // Not on a block
-        return false;
+        return entity_on_block(x, y);
     }
 
     void handle_platform_collisions(Tile platform) {
@@ -1821,54 +2814,8 @@ public:
         }
     }
     
-    void render(Camera camera) {
-        if (health != 0) {
-            bool visible = false;
-
-            if (immuneTimer) {
-                uint16_t immuneTimer_ms = (uint16_t)(immuneTimer * 1000);
-                if (immuneTimer_ms % 150 < 75) {
-                    visible = true;
-                }
-            }
-            else {
-                visible = true;
-            }
-
-            if (visible) {
-                uint16_t frame = anchorFrame;
-
-                if (yVel < -50) {
-                    frame = anchorFrame + 1;
-                }
-                else if (yVel > 160) {
-                    frame = anchorFrame + 2;
-                }
-
-                /*if (immuneTimer) {
-                    frame = anchorFrame + 3;
-                }*/
-
-                if (lastDirection == 1) {
-                    //screen.sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y), SpriteTransform::HORIZONTAL);
-                    render_sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y), SpriteTransform::HORIZONTAL);
-                }
-                else {
-                    //screen.sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
-                    render_sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
-                }
-            }
-        }
-
-        // Particles
-        for (uint8_t i = 0; i < particles.size(); i++) {
-            particles[i].render(camera);
-        }
-    }
-
     bool colliding(Tile tile) {
-        // Replace use of this with actual code?
-        return (tile.x + SPRITE_SIZE > x + 1 && tile.x < x + SPRITE_SIZE - 1 && tile.y + SPRITE_SIZE > y && tile.y < y + SPRITE_SIZE);
+        return entity_colliding(x, y, tile);
     }
 
     void set_immune() {
@@ -1887,353 +2834,850 @@ protected:
 
 
 
-class Enemy : public Entity {
-public:
-    float* playerX;
-    float* playerY;
+enum class EnemyType {
+    BASIC, // type 1
+    RANGED, // type 2
+    PURSUIT, // type 3
+    FLYING, // type 4
+    ARMOURED, // type 5
+    ARMOURED_RANGED, // type 6
+    ARMOURED_PURSUIT, // type 7
+    ARMOURED_FLYING, // type 8
+    SHOOTING // type 9
+};
 
-    Enemy() : Entity() {
-        enemyType = EnemyType::BASIC;
-        reloadTimer = 0;
-        rapidfireTimer = 0;
+// Enemy types which share the same update code (armoured types only differ by their starting health)
+enum class EnemyBehaviour {
+    WALKING, // BASIC, ARMOURED
+    RANGED, // RANGED, ARMOURED_RANGED
+    PURSUIT, // PURSUIT, ARMOURED_PURSUIT
+    FLYING, // FLYING, ARMOURED_FLYING
+    SHOOTING // SHOOTING
+};
+const uint8_t ENEMY_BEHAVIOUR_COUNT = 5;
+
+const EnemyBehaviour enemyBehaviours[] = {
+    EnemyBehaviour::WALKING,
+    EnemyBehaviour::RANGED,
+    EnemyBehaviour::PURSUIT,
+    EnemyBehaviour::FLYING,
+    EnemyBehaviour::WALKING,
+    EnemyBehaviour::RANGED,
+    EnemyBehaviour::PURSUIT,
+    EnemyBehaviour::FLYING,
+    EnemyBehaviour::SHOOTING
+};
 
-        playerX = nullptr;
-        playerY = nullptr;
+// Cold enemy data (hot data lives in the EntityStore arrays)
+struct EnemyData {
+    EnemyType type;
+    EnemyBehaviour behaviour;
+    uint16_t anchorFrame;
 
-        currentSpeed = ENTITY_IDLE_SPEED;
+    uint8_t state;
 
-        state = 0;
+    float currentSpeed;
 
-        shotsLeft = 0;
-    }
+    float reloadTimer;
+    float jumpCooldown;
 
-    Enemy(uint16_t xPosition, uint16_t yPosition, uint8_t startHealth, uint8_t type) : Entity(xPosition, yPosition, TILE_ID_ENEMY_1 + type * 4, startHealth) {
-        enemyType = (EnemyType)type;
-        reloadTimer = 0;
-        rapidfireTimer = 0;
+    // Used for SHOOTING enemy
+    float rapidfireTimer;
+    uint8_t shotsLeft;
 
-        playerX = nullptr;
-        playerY = nullptr;
+    std::vector<Particle> particles;
+};
+EntityStore<EnemyData> enemies;
+
+EntityHandle spawn_enemy(uint16_t xPosition, uint16_t yPosition, uint8_t type) {
+    EnemyData data;
+    data.type = (EnemyType)type;
+    data.behaviour = enemyBehaviours[type];
+    data.anchorFrame = TILE_ID_ENEMY_1 + type * 4;
+    data.state = 0;
+    data.currentSpeed = ENTITY_IDLE_SPEED;
+    data.reloadTimer = 0;
+    data.jumpCooldown = 0;
+    data.rapidfireTimer = 0;
+
+    if (data.type == EnemyType::SHOOTING) {
+        data.shotsLeft = SHOOTING_ENEMY_CLIP_SIZE;
+    }
+    else {
+        data.shotsLeft = 0;
+    }
 
-        currentSpeed = ENTITY_IDLE_SPEED;
+    return enemies.spawn(xPosition, yPosition, 0, 0, enemyHealths[type], 0, data);
+}
 
-        state = 0;
+// View of a single enemy in the enemies store.
+// Don't keep hold of one of these - spawning or removing enemies invalidates it (use an EntityHandle instead).
+class Enemy {
+public:
+    float &x, &y;
+    float &xVel, &yVel;
+    uint8_t &health;
+    uint8_t &lastDirection;
+    uint8_t &flags;
+    EnemyData &data;
+
+    Enemy(EntityStore<EnemyData>& store, uint16_t index) : x(store.x[index]), y(store.y[index]), xVel(store.xVel[index]), yVel(store.yVel[index]), health(store.health[index]), lastDirection(store.lastDirection[index]), flags(store.flags[index]), data(store.cold[index]) {
 
-        if (enemyType == EnemyType::SHOOTING) {
-            shotsLeft = SHOOTING_ENEMY_CLIP_SIZE;
-        }
-        else {
-            shotsLeft = 0;
-        }
     }
 
-    void update(float dt, ButtonStates buttonStates) {
-        if (health > 0) {
-            if (reloadTimer) {
-                reloadTimer -= dt;
-                if (reloadTimer < 0) {
-                    reloadTimer = 0;
-                }
+    void update_timers(float dt) {
+        if (data.reloadTimer) {
+            data.reloadTimer -= dt;
+            if (data.reloadTimer < 0) {
+                data.reloadTimer = 0;
             }
+        }
 
-            if (rapidfireTimer) {
-                rapidfireTimer -= dt;
-                if (rapidfireTimer < 0) {
-                    rapidfireTimer = 0;
-                }
+        if (data.rapidfireTimer) {
+            data.rapidfireTimer -= dt;
+            if (data.rapidfireTimer < 0) {
+                data.rapidfireTimer = 0;
             }
+        }
 
-            if (jumpCooldown) {
-                jumpCooldown -= dt;
-                if (jumpCooldown < 0) {
-                    jumpCooldown = 0;
-                }
+        if (data.jumpCooldown) {
+            data.jumpCooldown -= dt;
+            if (data.jumpCooldown < 0) {
+                data.jumpCooldown = 0;
             }
+        }
+    }
 
-            if (enemyType == EnemyType::BASIC || enemyType == EnemyType::ARMOURED) {
-                // Consider adding acceleration?
-                if (lastDirection) {
-                    xVel = currentSpeed;
-                }
-                else {
-                    xVel = -currentSpeed;
+    // Behaviour kernels, one specialisation per EnemyBehaviour (see below the class)
+    template<EnemyBehaviour B>
+    void update_behaviour(float dt, float playerX, float playerY);
+
+    void check_death_boundary() {
+        if (y > levelDeathBoundary) {
+            health = 0;
+            xVel = yVel = 0;
+        }
+    }
+
+    void update_death(float dt) {
+        //state = DEAD;
+
+        if (flags & ENTITY_FLAG_DEATH_PARTICLES) {
+            if (data.particles.size() == 0) {
+                // No particles left
+                //deathParticles = false;
+            }
+            else {
+                for (uint8_t i = 0; i < data.particles.size(); i++) {
+                    data.particles[i].update(dt, camera);
                 }
 
-                Entity::update_collisions();
+                // Remove any particles which are too old
+                data.particles.erase(std::remove_if(data.particles.begin(), data.particles.end(), [](Particle particle) { return (particle.age >= ENTITY_DEATH_PARTICLE_AGE); }), data.particles.end());
+            }
+        }
+        else {
+            // Generate particles
+            data.particles = generate_particles(x + SPRITE_HALF, y + SPRITE_HALF, ENTITY_DEATH_PARTICLE_GRAVITY_X, ENTITY_DEATH_PARTICLE_GRAVITY_Y, enemyDeathParticleColours[data.type == EnemyType::SHOOTING ? 4 : ((uint8_t)data.type % 4)], ENTITY_DEATH_PARTICLE_SPEED, ENTITY_DEATH_PARTICLE_COUNT);
+            flags |= ENTITY_FLAG_DEATH_PARTICLES;
+            // Play enemydeath sfx
+            audioHandler.play(3);
+        }
+    }
 
+    void walk() {
+        // Consider adding acceleration?
+        if (lastDirection) {
+            xVel = data.currentSpeed;
+        }
+        else {
+            xVel = -data.currentSpeed;
+        }
+    }
 
-                bool reverseDirection = true;
+    void patrol() {
+        if (is_wall_ahead() || !is_ground_ahead()) {
+            lastDirection = 1 - lastDirection;
+        }
+    }
 
-                float tempX = lastDirection ? x + SPRITE_SIZE : x - SPRITE_SIZE;
+    // Is there something to stand on in the next tile along?
+    bool is_ground_ahead() {
+        int16_t tileY = to_tile(y + SPRITE_SIZE);
 
-                for (uint16_t i = 0; i < platforms.size(); i++) {
-                    if (y + SPRITE_SIZE == platforms[i].y && platforms[i].x + SPRITE_SIZE > tempX + 1 && platforms[i].x < tempX + SPRITE_SIZE - 1) {
-                        // About to be on block
-                        reverseDirection = false;
-                    }
-                }
+        // Only counts if we're standing exactly on top of the tiles
+        if (y + SPRITE_SIZE != tileY * SPRITE_SIZE) {
+            return false;
+        }
 
-                for (uint16_t i = 0; i < foreground.size(); i++) {
-                    if (y + SPRITE_SIZE == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE - 1) {
-                        // About to be on block
-                        reverseDirection = false;
-                    }
-                    if (foreground[i].y + SPRITE_SIZE > y && foreground[i].y < y + SPRITE_SIZE && (lastDirection ? x + SPRITE_SIZE - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
-                        // Walked into side of block
-                        reverseDirection = true;
-                        // Break because we definitely need to change direction, and don't want any other blocks resetting this to false
-                        break;
-                    }
-                }
+        float tempX = lastDirection ? x + SPRITE_SIZE : x - SPRITE_SIZE;
 
-                if (reverseDirection) {
-                    lastDirection = 1 - lastDirection;
-                }
+        return tileGrid.is_ground(to_tile(tempX + 2), tileY) || tileGrid.is_ground(to_tile(tempX + SPRITE_SIZE - 2), tileY);
+    }
 
-                if (health == 1) {
-                    // EnemyType::ARMOURED has helmet on, and 2 hp
-                    enemyType = EnemyType::BASIC;
-                    anchorFrame = TILE_ID_ENEMY_1 + (int)enemyType * 4;
-                }
-            }
-            else if (enemyType == EnemyType::RANGED || enemyType == EnemyType::ARMOURED_RANGED) {
-                Entity::update_collisions();
+    // Have we walked into the side of a block?
+    bool is_wall_ahead() {
+        return tileGrid.is_solid(to_tile(lastDirection ? x + SPRITE_SIZE - 1 : x - 1), to_tile(y + SPRITE_HALF));
+    }
 
-                lastDirection = *playerX < x ? 0 : 1;
+    void remove_armour(EnemyType unarmouredType) {
+        if (health == 1) {
+            // Armoured enemies have helmet on, and 2 hp
+            data.type = unarmouredType;
+            data.anchorFrame = TILE_ID_ENEMY_1 + (int)data.type * 4;
+        }
+    }
 
-                if (std::abs(x - *playerX) < RANGED_MAX_RANGE && std::abs(y - *playerY) < RANGED_MAX_RANGE) {
-                    state = 1;
-                }
-                else {
-                    state = 0;
-                }
+    void update_collisions() {
+        // Update gravity
+        yVel += GRAVITY * dt;
+        yVel = std::min(yVel, (float)GRAVITY_MAX);
 
-                if (state == 1) {
-                    if (!reloadTimer) {
-                        // Fire!
-                        // Maybe make these values constants?
-                        projectiles.push_back(Projectile(x, y, RANGED_PROJECTILE_X_VEL_SCALE * (*playerX - x), -std::abs(x - *playerX) * RANGED_PROJECTILE_Y_VEL_SCALE + (*playerY - y) * RANGED_PROJECTILE_Y_VEL_SCALE, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_ENEMY_PROJECTILE_SNOWBALL : TILE_ID_ENEMY_PROJECTILE_ROCK));
-                        reloadTimer = RANGED_RELOAD_TIME;
+        // Move entity y
+        y += yVel * dt;
 
-                        audioHandler.play(6);
-                    }
+        // Here check collisions...
+        for (uint16_t i = 0; i < foreground.size(); i++) {
+            if (colliding(foreground[i])) {
+                if (yVel > 0) {
+                    // Collided from top
+                    y = foreground[i].y - SPRITE_SIZE;
                 }
-
-                if (health == 1) {
-                    // EnemyType::ARMOURED_RANGED has helmet on, and 2 hp
-                    enemyType = EnemyType::RANGED;
-                    anchorFrame = TILE_ID_ENEMY_1 + (int)enemyType * 4;
+                else if (yVel < 0) {
+                    // Collided from bottom
+                    y = foreground[i].y + SPRITE_SIZE;
                 }
+                yVel = 0;
             }
-            else if (enemyType == EnemyType::PURSUIT || enemyType == EnemyType::ARMOURED_PURSUIT) {
-                // Consider adding acceleration?
-                if (lastDirection) {
-                    xVel = currentSpeed;
-                }
-                else {
-                    xVel = -currentSpeed;
-                }
+        }
 
-                Entity::update_collisions();
+        // Platforms may need work
+        for (uint16_t i = 0; i < platforms.size(); i++) {
+            handle_platform_collisions(platforms[i]);
+        }
 
+        // Move entity x
+        x += xVel * dt;
 
-                if (std::abs(x - *playerX) < PURSUIT_MAX_RANGE && std::abs(y - *playerY) < PURSUIT_MAX_RANGE) {
-                    state = 1;
+        // Here check collisions...
+        for (uint16_t i = 0; i < foreground.size(); i++) {
+            if (colliding(foreground[i])) {
+                if (xVel > 0) {
+                    // Collided from left
+                    x = foreground[i].x - SPRITE_SIZE + 1;
                 }
-                else {
-                    state = 0;
+                else if (xVel < 0) {
+                    // Collided from right
+                    x = foreground[i].x + SPRITE_SIZE - 1;
                 }
+                xVel = 0;
+            }
+        }
 
-                if (state == 0) {
-                    // Just patrol... (Same as basic enemy)
-                    currentSpeed = ENTITY_IDLE_SPEED;
-
-                    bool reverseDirection = true;
+        if (xVel > 0) {
+            lastDirection = 1;
+        }
+        else if (xVel < 0) {
+            lastDirection = 0;
+        }
+    }
 
-                    float tempX = lastDirection ? x + SPRITE_SIZE : x - SPRITE_SIZE;
+    void handle_platform_collisions(Tile platform) {
+        if (colliding(platform)) {
+            if (yVel > 0 && y + SPRITE_SIZE < platform.y + SPRITE_QUARTER) {
+                // Collided from top
+                y = platform.y - SPRITE_SIZE;
+                yVel = 0;
+            }
+        }
+    }
 
-                    for (uint16_t i = 0; i < platforms.size(); i++) {
-                        if (y + SPRITE_SIZE == platforms[i].y && platforms[i].x + SPRITE_SIZE > tempX + 1 && platforms[i].x < tempX + SPRITE_SIZE - 1) {
-                            // About to be on block
-                            reverseDirection = false;
-                        }
-                    }
+    void jump(float jumpVel, float cooldown) {
+        // Jump
+        yVel = -jumpVel;
+        data.jumpCooldown = cooldown;
+    }
 
-                    for (uint16_t i = 0; i < foreground.size(); i++) {
-                        if (y + SPRITE_SIZE == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE - 1) {
-                            // About to be on block
-                            reverseDirection = false;
-                        }
-                        if (foreground[i].y + SPRITE_SIZE > y && foreground[i].y < y + SPRITE_SIZE && (lastDirection ? x + SPRITE_SIZE - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
-                            // Walked into side of block
-                            reverseDirection = true;
-                            // Break because we definitely need to change direction, and don't want any other blocks resetting this to false
-                            break;
-                        }
-                    }
+    bool is_on_block() {
+        return entity_on_block(x, y);
+    }
 
-                    if (reverseDirection) {
-                        lastDirection = 1 - lastDirection;
-                    }
+    bool colliding(Tile tile) {
+        return entity_colliding(x, y, tile);
+    }
+
+    void render(Camera camera) {
+        if (health != 0) {
+            uint16_t frame = data.anchorFrame;
+
+            if (yVel < -50) {
+                frame = data.anchorFrame + 1;
+            }
+            else if (yVel > 160) {
+                frame = data.anchorFrame + 2;
+            }
+
+            if (lastDirection == 1) {
+                render_sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y), SpriteTransform::HORIZONTAL);
+            }
+            else {
+                render_sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
+            }
+        }
+
+        // Particles
+        for (uint8_t i = 0; i < data.particles.size(); i++) {
+            data.particles[i].render(camera);
+        }
+    }
+};
+
+
+// BASIC and ARMOURED
+template<>
+void Enemy::update_behaviour<EnemyBehaviour::WALKING>(float, float, float) {
+    walk();
+
+    update_collisions();
+
+    patrol();
+
+    remove_armour(EnemyType::BASIC);
+}
+
+// RANGED and ARMOURED_RANGED
+template<>
+void Enemy::update_behaviour<EnemyBehaviour::RANGED>(float, float playerX, float playerY) {
+    update_collisions();
+
+    lastDirection = playerX < x ? 0 : 1;
+
+    if (std::abs(x - playerX) < RANGED_MAX_RANGE && std::abs(y - playerY) < RANGED_MAX_RANGE) {
+        data.state = 1;
+    }
+    else {
+        data.state = 0;
+    }
+
+    if (data.state == 1) {
+        if (!data.reloadTimer) {
+            // Fire!
+            // Maybe make these values constants?
+            spawn_projectile(x, y, RANGED_PROJECTILE_X_VEL_SCALE * (playerX - x), -std::abs(x - playerX) * RANGED_PROJECTILE_Y_VEL_SCALE + (playerY - y) * RANGED_PROJECTILE_Y_VEL_SCALE, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_ENEMY_PROJECTILE_SNOWBALL : TILE_ID_ENEMY_PROJECTILE_ROCK);
+            data.reloadTimer = RANGED_RELOAD_TIME;
+
+            audioHandler.play(6);
+        }
+    }
+
+    remove_armour(EnemyType::RANGED);
+}
+
+// PURSUIT and ARMOURED_PURSUIT
+template<>
+void Enemy::update_behaviour<EnemyBehaviour::PURSUIT>(float, float playerX, float playerY) {
+    walk();
+
+    update_collisions();
+
+
+    if (std::abs(x - playerX) < PURSUIT_MAX_RANGE && std::abs(y - playerY) < PURSUIT_MAX_RANGE) {
+        data.state = 1;
+    }
+    else {
+        data.state = 0;
+    }
+
+    if (data.state == 0) {
+        // Just patrol... (Same as basic enemy)
+        data.currentSpeed = ENTITY_IDLE_SPEED;
+
+        patrol();
+    }
+    else if (data.state == 1) {
+        // Pursue!
+        data.currentSpeed = ENTITY_PURSUIT_SPEED;
+
+        // Follow the shared flow field, so that we find a way round obstacles
+        lastDirection = playerFlowField.get_direction(x + SPRITE_HALF, y + SPRITE_HALF, SPRITE_HALF, playerX < x ? 0 : 1);
+
+        bool shouldJump = is_wall_ahead() || !is_ground_ahead();
+
+        if (shouldJump && data.jumpCooldown == 0) {
+            if (is_on_block()) {
+                jump(ENTITY_JUMP_SPEED, ENTITY_JUMP_COOLDOWN);
+            }
+        }
+    }
+
+    remove_armour(EnemyType::PURSUIT);
+}
+
+// FLYING and ARMOURED_FLYING
+template<>
+void Enemy::update_behaviour<EnemyBehaviour::FLYING>(float, float, float) {
+    // Should it be EnemyType::BOUNCING instead?
+    walk();
+
+    update_collisions();
+
+
+    bool reverseDirection = false;
+    for (uint16_t i = 0; i < foreground.size(); i++) {
+        if (foreground[i].y + SPRITE_SIZE > y && foreground[i].y < y + SPRITE_SIZE && (lastDirection ? x + SPRITE_SIZE - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
+            // Walked into side of block
+            reverseDirection = true;
+            // Break because we definitely need to change direction, and don't want any other blocks resetting this to false
+            break;
+        }
+    }
+
+    if (data.jumpCooldown == 0 && is_on_block()) {
+        jump(ENTITY_JUMP_SPEED, ENTITY_JUMP_COOLDOWN);
+    }
+
+    if (reverseDirection) {
+        lastDirection = 1 - lastDirection;
+    }
+
+    remove_armour(EnemyType::FLYING);
+}
+
+template<>
+void Enemy::update_behaviour<EnemyBehaviour::SHOOTING>(float, float playerX, float playerY) {
+    update_collisions();
+
+    lastDirection = playerX < x ? 0 : 1;
+
+    if (std::abs(x - playerX) < SHOOTING_MAX_RANGE_X && std::abs(y - playerY) < SHOOTING_MAX_RANGE_Y) {
+        data.state = 1;
+    }
+    else {
+        data.state = 0;
+    }
+
+    if (data.state == 1) {
+        if (!data.reloadTimer && !data.shotsLeft) {
+            data.shotsLeft = SHOOTING_ENEMY_CLIP_SIZE;
+        }
+        if (data.shotsLeft && !data.rapidfireTimer) {
+            // Fire!
+            // Maybe make these values constants?
+            float magnitude = std::sqrt(std::pow(playerX - x, 2) + std::pow(playerY - y, 2));
+            spawn_projectile(x, y, BULLET_PROJECTILE_SPEED * (playerX - x) / magnitude, BULLET_PROJECTILE_SPEED * (playerY - y) / magnitude, TILE_ID_ENEMY_PROJECTILE_BULLET, false, SPRITE_QUARTER);
+            data.shotsLeft--;
+            data.rapidfireTimer = SHOOTING_RAPID_RELOAD_TIME;
+
+            if (!data.shotsLeft) {
+                data.reloadTimer = SHOOTING_RELOAD_TIME;
+            }
+
+            audioHandler.play(6);
+        }
+    }
+}
+
+// Indices of living enemies, grouped by behaviour (rebuilt each frame, since removing enemies changes indices)
+std::vector<uint16_t> enemyBatches[ENEMY_BEHAVIOUR_COUNT];
+
+template<EnemyBehaviour B>
+void update_enemy_batch(float dt, float playerX, float playerY) {
+    const std::vector<uint16_t>& batch = enemyBatches[(uint8_t)B];
+
+    for (uint16_t i = 0; i < batch.size(); i++) {
+        Enemy enemy(enemies, batch[i]);
+
+        enemy.update_timers(dt);
+        enemy.update_behaviour<B>(dt, playerX, playerY);
+        enemy.check_death_boundary();
+    }
+}
+
+
+class Boss : public Entity {
+public:
+    float* playerX;
+    float* playerY;
+
+    Boss() : Entity() {
+        spawnX = spawnY = 0;
+
+        enemyType = EnemyType::BASIC;
+        reloadTimer = 0;
+        rapidfireTimer = 0;
+        shotsLeft = 0;
+        state = 0;
+
+        playerX = nullptr;
+        playerY = nullptr;
+
+        anchorFrame = TILE_ID_BOSS_1;
+
+        currentSpeed = BOSS_1_IDLE_SPEED;
+
+        injuredTimer = 0;
+        minionsToSpawn = 0;
+        dead = false;
+        shakeOnLanding = 0;
+    }
+
+    Boss(uint16_t xPosition, uint16_t yPosition, uint8_t startHealth, uint8_t type) : Entity(xPosition, yPosition, TILE_ID_BOSS_1, startHealth) {
+        spawnX = xPosition;
+        spawnY = yPosition;
+
+        enemyType = (EnemyType)type;
+        reloadTimer = 0;
+        rapidfireTimer = 0;
+        shotsLeft = 0;
+        state = 0;
+
+        playerX = nullptr;
+        playerY = nullptr;
+
+        anchorFrame = TILE_ID_BOSS_1 + type * 8;
+        if (type == 2) {
+            anchorFrame += 16;
+        }
+
+        currentSpeed = BOSS_1_IDLE_SPEED;
+
+        injuredTimer = 0;
+        minionsToSpawn = 0;
+        dead = false;
+        shakeOnLanding = 0;
+    }
+
+    void update(float dt, ButtonStates buttonStates);
+
+    uint8_t get_direction_to_spawn() {
+        uint8_t size = get_size();
+
+        // Only calculated the first time, since spawn doesn't move
+        FlowField& spawnFlowField = get_spawn_flow_field(spawnX + size / 2, spawnY + size - SPRITE_HALF);
+
+        return spawnFlowField.get_direction(x + size / 2, y + size - SPRITE_HALF, size / 2, spawnX + size / 2 < x + size / 2 ? 0 : 1);
+    }
+
+    // Is there something to stand on in the next tiles along?
+    bool is_ground_ahead() {
+        uint8_t size = get_size();
+        int16_t tileY = to_tile(y + size);
+
+        // Only counts if we're standing exactly on top of the tiles
+        if (y + size != tileY * SPRITE_SIZE) {
+            return false;
+        }
+
+        float tempX = lastDirection ? x + size : x - size;
+
+        for (uint8_t i = 0; i < size; i += SPRITE_SIZE) {
+            if (tileGrid.is_solid(to_tile(tempX + i + SPRITE_HALF), tileY)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Have we walked into the side of a block?
+    bool is_wall_ahead() {
+        uint8_t size = get_size();
+        int16_t tileX = to_tile(lastDirection ? x + size - 1 : x - 1);
+
+        for (uint8_t i = 0; i < size; i += SPRITE_SIZE) {
+            if (tileGrid.is_solid(tileX, to_tile(y + i + SPRITE_HALF))) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Behaviour kernels, one specialisation per boss type (see below the class)
+    template<EnemyType T>
+    void update_behaviour(float dt);
+
+    bool is_on_block() {
+        if (is_big()) {
+            // Allow boss to jump on tiles
+            for (uint16_t i = 0; i < foreground.size(); i++) {
+                if (y + SPRITE_SIZE * 4 == foreground[i].y && foreground[i].x + SPRITE_SIZE - 1 > x && foreground[i].x + 1 < x + SPRITE_SIZE * 4) {
+                    // On top of block
+                    return true;
+                }
+            }
+
+            // Allow boss to jump on platforms
+            for (uint16_t i = 0; i < platforms.size(); i++) {
+                if (y + SPRITE_SIZE * 4 == platforms[i].y && platforms[i].x + SPRITE_SIZE - 1 > x && platforms[i].x + 1 < x + SPRITE_SIZE * 4) {
+                    // On top of block
+                    return true;
+                }
+            }
+        }
+        else {
+            // Allow boss to jump on tiles
+            for (uint16_t i = 0; i < foreground.size(); i++) {
+                if (y + SPRITE_SIZE * 2 == foreground[i].y && foreground[i].x + SPRITE_SIZE - 1 > x && foreground[i].x + 1 < x + SPRITE_SIZE * 2) {
+                    // On top of block
+                    return true;
                 }
-                else if (state == 1) {
-                    // Pursue!
-                    currentSpeed = ENTITY_PURSUIT_SPEED;
+            }
 
-                    lastDirection = *playerX < x ? 0 : 1;
+            // Allow boss to jump on platforms
+            for (uint16_t i = 0; i < platforms.size(); i++) {
+                if (y + SPRITE_SIZE * 2 == platforms[i].y && platforms[i].x + SPRITE_SIZE - 1 > x && platforms[i].x + 1 < x + SPRITE_SIZE * 2) {
+                    // On top of block
+                    return true;
+                }
+            }
+        }
 
-                    bool shouldJump = true;
+        // Boss didn't jump
+        return false;
 
-                    float tempX = lastDirection ? x + SPRITE_SIZE : x - SPRITE_SIZE;
+    }
 
-                    for (uint16_t i = 0; i < platforms.size(); i++) {
-                        if (y + SPRITE_SIZE == platforms[i].y && platforms[i].x + SPRITE_SIZE > tempX + 1 && platforms[i].x < tempX + SPRITE_SIZE - 1) {
-                            // About to be on block
-                            shouldJump = false;
-                            break;
-                        }
-                    }
+    void set_immune() {
+        immuneTimer = BOSS_IMMUNE_TIME;
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+    }
 
-                    for (uint16_t i = 0; i < foreground.size(); i++) {
-                        if (y + SPRITE_SIZE == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE - 1) {
-                            // About to be on block
-                            shouldJump = false;
-                            break;
+    bool is_immune() {
+        if (enemyType == EnemyType::BASIC) {
+            return Entity::is_immune() || state >= 2;
+        }
+        else if (enemyType == EnemyType::RANGED) {
+            return Entity::is_immune() || state >= 2;
+        }
+        else if (enemyType == EnemyType::PURSUIT) {
+            return Entity::is_immune() || state >= 2;
+        }
+        else {
+            // Catch-all
+            return false;
+        }
+    }
+
+    void set_injured() {
+        injuredTimer = BOSS_INJURED_TIME;
+        set_immune();
+    }
+
+    uint8_t get_size() {
+        if (is_big()) {
+            return SPRITE_SIZE * 4;
+        }
+        else {
+            return SPRITE_SIZE * 2;
+        }
+    }
+
+    bool is_big() {
+        return enemyType == EnemyType::PURSUIT;
+    }
+
+    bool is_within_range(float me, float them, float range) {
+        //return get_range(me, them) < range;
+        return get_abs_center_range(me, them) < range;
+    }
+
+    //float get_range(float me, float them) {
+    //    if (them > me) {
+    //        // They are right
+    //        return them - (me + SPRITE_SIZE * 2);
+    //    }
+    //    else {
+    //        // They are left
+    //        return me - (them + SPRITE_SIZE);
+    //    }
+    //}
+
+    float get_center_range(float me, float them) {
+        return (me + SPRITE_SIZE) - (them + SPRITE_HALF);
+    }
+
+    float get_abs_center_range(float me, float them) {
+        return std::abs(get_center_range(me, them));
+    }
+
+    void update_collisions() {
+        if (!locked) {
+            // Update gravity
+            yVel += GRAVITY * dt;
+            yVel = std::min(yVel, (float)GRAVITY_MAX);
+
+            // Move entity y
+            y += yVel * dt;
+
+            // Here check collisions...
+            for (uint16_t i = 0; i < foreground.size(); i++) {
+                if (colliding(foreground[i])) {
+                    if (yVel > 0) {
+                        // Collided from top
+                        y = foreground[i].y - SPRITE_SIZE * (is_big() ? 4 : 2);
+                        if (shakeOnLanding) {
+                            shaker.set_shake(shakeOnLanding);
+                            shakeOnLanding = 0;
+                            audioHandler.play(4);
                         }
                     }
-                    for (uint16_t i = 0; i < foreground.size(); i++) {
-                        if ((lastDirection ? x + SPRITE_SIZE - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
-                            // Walked into side of block
-                            shouldJump = true;
-                            // Break because we definitely need to jump
-                            break;
-                        }
+                    else if (yVel < 0) {
+                        // Collided from bottom
+                        y = foreground[i].y + SPRITE_SIZE;
                     }
+                    yVel = 0;
+                }
+            }
 
-                    if (shouldJump && jumpCooldown == 0) {
-                        if (is_on_block()) {
-                            jump(ENTITY_JUMP_SPEED, ENTITY_JUMP_COOLDOWN);
+            // Platforms may need work
+            if (!is_big()) {
+                for (uint16_t i = 0; i < platforms.size(); i++) {
+                    if (colliding(platforms[i])) {
+                        if (yVel > 0 && y + SPRITE_SIZE * 2 < platforms[i].y + SPRITE_QUARTER) {
+                            // Collided from top
+                            y = platforms[i].y - SPRITE_SIZE * 2;
+                            if (shakeOnLanding) {
+                                shaker.set_shake(shakeOnLanding);
+                                shakeOnLanding = 0;
+                                audioHandler.play(4);
+                            }
+                            yVel = 0;
                         }
                     }
                 }
+            }
+
+            // Move entity x
+            x += xVel * dt;
 
-                if (health == 1) {
-                    // EnemyType::ARMOURED_PURSUIT has helmet on, and 2 hp
-                    enemyType = EnemyType::PURSUIT;
-                    anchorFrame = TILE_ID_ENEMY_1 + (int)enemyType * 4;
+            // Here check collisions...
+            for (uint16_t i = 0; i < foreground.size(); i++) {
+                if (colliding(foreground[i])) {
+                    if (xVel > 0) {
+                        // Collided from left
+                        x = foreground[i].x - SPRITE_SIZE * (is_big() ? 4 : 2) + 1;
+                    }
+                    else if (xVel < 0) {
+                        // Collided from right
+                        x = foreground[i].x + SPRITE_SIZE - 1;
+                    }
+                    xVel = 0;
                 }
             }
-            else if (enemyType == EnemyType::FLYING || enemyType == EnemyType::ARMOURED_FLYING) {
-                // Should it be EnemyType::BOUNCING instead?
-                // Consider adding acceleration?
-                if (lastDirection) {
-                    xVel = currentSpeed;
+
+            if (xVel > 0) {
+                lastDirection = 1;
+            }
+            else if (xVel < 0) {
+                lastDirection = 0;
+            }
+        }
+    }
+
+    void render(Camera camera) {
+        if (!dead) {
+            if (is_big()) {
+                uint16_t frame = anchorFrame;
+
+                //if (true) { //state != 0 //health < 3
+                //    frame = anchorFrame + 8 + 16 * 4;
+                //}
+
+                if (yVel < -50) {
+                    frame = anchorFrame + 4;
                 }
-                else {
-                    xVel = -currentSpeed;
+                else if (yVel > 160) {
+                    frame = anchorFrame + 8;
                 }
 
-                Entity::update_collisions();
-
+                if (injuredTimer) {
+                    frame = anchorFrame + 12;
+                }
 
-                bool reverseDirection = false;
-                float tempX = lastDirection ? x + SPRITE_SIZE : x - SPRITE_SIZE;
-                for (uint16_t i = 0; i < foreground.size(); i++) {
-                    if (foreground[i].y + SPRITE_SIZE > y && foreground[i].y < y + SPRITE_SIZE && (lastDirection ? x + SPRITE_SIZE - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
-                        // Walked into side of block
-                        reverseDirection = true;
-                        // Break because we definitely need to change direction, and don't want any other blocks resetting this to false
-                        break;
+                if (lastDirection == 1) {
+                    for (uint8_t i = 0; i < 4; i++) {
+                        for (uint8_t j = 0; j < 4; j++) {
+                            render_sprite(frame + i + j * 16, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE * (3 - i), SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE * j), SpriteTransform::HORIZONTAL);
+                        }
+                    }
+                }
+                else {
+                    for (uint8_t i = 0; i < 4; i++) {
+                        for (uint8_t j = 0; j < 4; j++) {
+                            render_sprite(frame + i + j * 16, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE * i, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE * j));
+                        }
                     }
-                    /*if (jumpCooldown == 0 && y + SPRITE_SIZE == foreground[i].y && foreground[i].x + SPRITE_SIZE - 1 > x && foreground[i].x + 1 < x + SPRITE_SIZE) {
-                        yVel = -ENTITY_JUMP_SPEED;
-                        jumpCooldown = ENTITY_JUMP_COOLDOWN;
-                    }*/
                 }
+            }
+            else {
+                uint16_t frame = anchorFrame;
 
-                if (jumpCooldown == 0 && is_on_block()) {
-                    jump(ENTITY_JUMP_SPEED, ENTITY_JUMP_COOLDOWN);
+                if (yVel < -50) {
+                    frame = anchorFrame + 2;
                 }
-
-                if (reverseDirection) {
-                    lastDirection = 1 - lastDirection;
+                else if (yVel > 160) {
+                    frame = anchorFrame + 4;
                 }
 
-                if (health == 1) {
-                    // EnemyType::ARMOURED_FLYING has helmet on, and 2 hp
-                    enemyType = EnemyType::FLYING;
-                    anchorFrame = TILE_ID_ENEMY_1 + (int)enemyType * 4;
+                if (injuredTimer) {
+                    frame = anchorFrame + 6;
                 }
-            }
-            else if (enemyType == EnemyType::SHOOTING) {
-                Entity::update_collisions();
 
-                lastDirection = *playerX < x ? 0 : 1;
-
-                if (std::abs(x - *playerX) < SHOOTING_MAX_RANGE_X && std::abs(y - *playerY) < SHOOTING_MAX_RANGE_Y) {
-                    state = 1;
+                if (lastDirection == 1) {
+                    //screen.sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y), SpriteTransform::HORIZONTAL);
+                    render_sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE, SCREEN_MID_HEIGHT + y - camera.y), SpriteTransform::HORIZONTAL);
+                    render_sprite(frame + 1, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y), SpriteTransform::HORIZONTAL);
+                    render_sprite(frame + 16, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE), SpriteTransform::HORIZONTAL);
+                    render_sprite(frame + 17, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE), SpriteTransform::HORIZONTAL);
                 }
                 else {
-                    state = 0;
-                }
-
-                if (state == 1) {
-                    if (!reloadTimer && !shotsLeft) {
-                        shotsLeft = SHOOTING_ENEMY_CLIP_SIZE;
-                    }
-                    if (shotsLeft && !rapidfireTimer) {
-                        // Fire!
-                        // Maybe make these values constants?
-                        float magnitude = std::sqrt(std::pow(*playerX - x, 2) + std::pow(*playerY - y, 2));
-                        projectiles.push_back(Projectile(x, y, BULLET_PROJECTILE_SPEED * (*playerX - x) / magnitude, BULLET_PROJECTILE_SPEED * (*playerY - y) / magnitude, TILE_ID_ENEMY_PROJECTILE_BULLET, false, SPRITE_QUARTER));
-                        shotsLeft--;
-                        rapidfireTimer = SHOOTING_RAPID_RELOAD_TIME;
-
-                        if (!shotsLeft) {
-                            reloadTimer = SHOOTING_RELOAD_TIME;
-                        }
-
-                        audioHandler.play(6);
-                    }
+                    //screen.sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
+                    render_sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
+                    render_sprite(frame + 1, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE, SCREEN_MID_HEIGHT + y - camera.y));
+                    render_sprite(frame + 16, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE));
+                    render_sprite(frame + 17, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE));
                 }
             }
+        }
 
+        // Particles
+        for (uint8_t i = 0; i < particles.size(); i++) {
+            particles[i].render(camera);
+        }
+    }
 
-            if (y > levelDeathBoundary) {
-                health = 0;
-                xVel = yVel = 0;
-            }
+    bool colliding(Tile tile) {
+        if (is_big()) {
+            return (tile.x + SPRITE_SIZE > x + 1 && tile.x < x + SPRITE_SIZE * 4 - 1 && tile.y + SPRITE_SIZE > y && tile.y < y + SPRITE_SIZE * 4);
+        }
+        else {
+            return (tile.x + SPRITE_SIZE > x + 1 && tile.x < x + SPRITE_SIZE * 2 - 1 && tile.y + SPRITE_SIZE > y && tile.y < y + SPRITE_SIZE * 2);
         }
+    }
 
-        if (health == 0) {
-            //state = DEAD;
+    bool spawning_minions() {
+        return minionsToSpawn;
+    }
 
-            if (deathParticles) {
-                if (particles.size() == 0) {
-                    // No particles left
-                    //deathParticles = false;
-                }
-                else {
-                    for (uint8_t i = 0; i < particles.size(); i++) {
-                        particles[i].update(dt);
-                    }
+    bool is_dead() const {
+        return dead;
+    }
 
-                    // Remove any particles which are too old
-                    particles.erase(std::remove_if(particles.begin(), particles.end(), [](Particle particle) { return (particle.age >= ENTITY_DEATH_PARTICLE_AGE); }), particles.end());
-                }
-            }
-            else {
-                // Generate particles
-                particles = generate_particles(x + SPRITE_HALF, y + SPRITE_HALF, ENTITY_DEATH_PARTICLE_GRAVITY_X, ENTITY_DEATH_PARTICLE_GRAVITY_Y, enemyDeathParticleColours[enemyType == EnemyType::SHOOTING ? 4 : ((uint8_t)enemyType % 4)], ENTITY_DEATH_PARTICLE_SPEED, ENTITY_DEATH_PARTICLE_COUNT);
-                deathParticles = true;
-                // Play enemydeath sfx
-                audioHandler.play(3);
-            }
-        }
+    bool particles_left() const {
+        return deathParticles;
     }
 
-    void render(Camera camera) {
-        Entity::render(camera);
+    void reset() {
+        dead = false;
+        particles.clear();
+        shakeOnLanding = false;
+        x = spawnX;
+        y = spawnY;
+        injuredTimer = 0;
+        minionsToSpawn = 0;
+        state = 0;
+        health = bossHealths[(uint8_t)enemyType];
     }
 
     void set_player_position(float* x, float* y) {
@@ -2241,30 +3685,14 @@ public:
         playerY = y;
     }
 
-    void set_speed(float speed) {
-        currentSpeed = speed;
-    }
-
     uint8_t get_state() {
         return state;
     }
 
 protected:
-    enum class EnemyType {
-        BASIC, // type 1
-        RANGED, // type 2
-        PURSUIT, // type 3
-        FLYING, // type 4
-        ARMOURED, // type 5
-        ARMOURED_RANGED, // type 6
-        ARMOURED_PURSUIT, // type 7
-        ARMOURED_FLYING, // type 8
-        SHOOTING // type 9
-    } enemyType;
+    EnemyType enemyType;
 
     float reloadTimer;
-
-    // Used for SHOOTING enemy
     float rapidfireTimer;
     uint8_t shotsLeft;
 
@@ -2272,986 +3700,839 @@ protected:
 
     uint8_t state;
 
-    //enum EntityState {
-    //    IDLE,
-    //    WALK,
-    //    //RUN,
-    //    JUMP,
-    //    //CROUCH,
-    //    //INJURED,
-    //    DEAD
-    //} state;
-};
-std::vector<Enemy> enemies;
-
+    float injuredTimer;
+    uint8_t minionsToSpawn;
 
-class Boss : public Enemy {
-public:
-    Boss() : Enemy() {
-        spawnX = spawnY = 0;
+    uint16_t spawnX, spawnY;
+    bool dead;
+    float shakeOnLanding;
+};
 
-        anchorFrame = TILE_ID_BOSS_1;
+template<>
+void Boss::update_behaviour<EnemyType::BASIC>(float dt) {
+    if (lastDirection) {
+        xVel = currentSpeed;
+    }
+    else {
+        xVel = -currentSpeed;
+    }
 
-        currentSpeed = BOSS_1_IDLE_SPEED;
+    update_collisions();
 
-        injuredTimer = 0;
-        minionsToSpawn = 0;
-        dead = false;
-        shakeOnLanding = 0;
-    }
+    if (state == 0) {
+        // IDLE
 
-    Boss(uint16_t xPosition, uint16_t yPosition, uint8_t startHealth, uint8_t type) : Enemy(xPosition, yPosition, startHealth, type) {
-        spawnX = xPosition;
-        spawnY = yPosition;
+        if (is_within_range(x, spawnX, BOSS_1_RETURN_TO_SPAWN_RANGE)) {
+            // Wait
+            currentSpeed = 0;
 
-        anchorFrame = TILE_ID_BOSS_1 + type * 8;
-        if (type == 2) {
-            anchorFrame += 16;
+            lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
         }
+        else {
+            // Return to spawn
+            currentSpeed = BOSS_1_IDLE_SPEED;
 
-        currentSpeed = BOSS_1_IDLE_SPEED;
+            lastDirection = get_direction_to_spawn();
 
-        injuredTimer = 0;
-        minionsToSpawn = 0;
-        dead = false;
-        shakeOnLanding = 0;
-    }
+            bool shouldJump = is_wall_ahead() || !is_ground_ahead();
 
-    void update(float dt, ButtonStates buttonStates) {
-        if (jumpCooldown) {
-            jumpCooldown -= dt;
-            if (jumpCooldown < 0) {
-                jumpCooldown = 0;
+            if (shouldJump && !jumpCooldown) {
+                if (is_on_block()) {
+                    shakeOnLanding = BOSS_1_JUMP_SHAKE_TIME;
+                    jump(BOSS_1_JUMP_SPEED, BOSS_1_JUMP_COOLDOWN);
+                }
             }
         }
 
-        if (injuredTimer) {
-            injuredTimer -= dt;
-            if (injuredTimer < 0) {
-                injuredTimer = 0;
-            }
-        }
 
-        if (immuneTimer) {
-            immuneTimer -= dt;
-            if (immuneTimer < 0) {
-                immuneTimer = 0;
-            }
-        }
+        // Handle states
+        if (is_within_range(x, *playerX, BOSS_1_JUMP_TRIGGER_MAX_RANGE) && is_within_range(y, *playerY, BOSS_1_JUMP_TRIGGER_MAX_RANGE)) {
+            state = 1;
+            bossBattle = true;
 
-        if (reloadTimer) {
-            reloadTimer -= dt;
-            if (reloadTimer < 0) {
-                reloadTimer = 0;
-            }
-        }
+            lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
 
-        if (rapidfireTimer) {
-            rapidfireTimer -= dt;
-            if (rapidfireTimer < 0) {
-                rapidfireTimer = 0;
+
+            // JUMP
+            if (is_on_block()) {
+                shakeOnLanding = BOSS_1_ANGRY_JUMP_SHAKE_TIME;
+                jump(BOSS_1_ANGRY_JUMP_SPEED, BOSS_1_JUMP_COOLDOWN);
             }
         }
+    }
+    else if (state == 1) {
+        // PURSUE
 
-        if (enemyType == EnemyType::BASIC) {
-            if (lastDirection) {
-                xVel = currentSpeed;
-            }
-            else {
-                xVel = -currentSpeed;
+        // Only go fast once on ground
+        for (uint16_t i = 0; i < foreground.size(); i++) {
+            if (y + SPRITE_SIZE * 2 == foreground[i].y && foreground[i].x + SPRITE_SIZE - 1 > x && foreground[i].x + 1 < x + SPRITE_SIZE * 2) {
+                // On block
+                currentSpeed = BOSS_1_PURSUIT_SPEED;
             }
+        }
 
-            update_collisions();
-
-            if (state == 0) {
-                // IDLE
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
 
-                if (is_within_range(x, spawnX, BOSS_1_RETURN_TO_SPAWN_RANGE)) {
-                    // Wait
-                    currentSpeed = 0;
+        bool shouldJump = true;
 
-                    lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
-                }
-                else {
-                    // Return to spawn
-                    currentSpeed = BOSS_1_IDLE_SPEED;
+        float tempX = lastDirection ? x + SPRITE_SIZE * 2 : x - SPRITE_SIZE * 2;
+        for (uint16_t i = 0; i < foreground.size(); i++) {
+            if (y + SPRITE_SIZE * 2 == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE * 2 - 1) {
+                // About to be on block
+                shouldJump = false;
+                break;
+            }
+        }
+        for (uint16_t i = 0; i < foreground.size(); i++) {
+            if ((lastDirection ? x + SPRITE_SIZE * 2 - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
+                // Walked into side of block
+                shouldJump = true;
+                // Break because we definitely need to jump
+                break;
+            }
+        }
 
-                    lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
 
-                    bool shouldJump = true;
+        if (shouldJump && !jumpCooldown) {
+            if (is_on_block()) {
+                shakeOnLanding = BOSS_1_JUMP_SHAKE_TIME;
+                jump(BOSS_1_JUMP_SPEED, BOSS_1_JUMP_COOLDOWN);
+            }
+        }
 
-                    float tempX = lastDirection ? x + SPRITE_SIZE * 2 : x - SPRITE_SIZE * 2;
-                    for (uint16_t i = 0; i < foreground.size(); i++) {
-                        if (y + SPRITE_SIZE * 2 == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE * 2 - 1) {
-                            // About to be on block
-                            shouldJump = false;
-                            break;
-                        }
-                    }
-                    for (uint16_t i = 0; i < foreground.size(); i++) {
-                        if ((lastDirection ? x + SPRITE_SIZE * 2 - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
-                            // Walked into side of block
-                            shouldJump = true;
-                            // Break because we definitely need to jump
-                            break;
-                        }
-                    }
 
-                    if (shouldJump && !jumpCooldown) {
-                        if (is_on_block()) {
-                            shakeOnLanding = BOSS_1_JUMP_SHAKE_TIME;
-                            jump(BOSS_1_JUMP_SPEED, BOSS_1_JUMP_COOLDOWN);
-                        }
-                    }
-                }
 
+        // Handle states
+        if (!is_within_range(x, *playerX, BOSS_1_IGNORE_MIN_RANGE) || !is_within_range(y, *playerY, BOSS_1_IGNORE_MIN_RANGE)) {
+            state = 0;
+        }
+        else if (is_immune()) {
+            state = 2;
+            // slow down player
+            slowPlayer = true;
+        }
+    }
+    else if (state == 2) {
+        // IMMUNE
 
-                // Handle states
-                if (is_within_range(x, *playerX, BOSS_1_JUMP_TRIGGER_MAX_RANGE) && is_within_range(y, *playerY, BOSS_1_JUMP_TRIGGER_MAX_RANGE)) {
-                    state = 1;
-                    bossBattle = true;
+        currentSpeed = BOSS_1_ANGRY_SPEED - BOSS_1_SPEED_REDUCTION_SCALE * get_abs_center_range(x, *playerX);
 
-                    lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+        //printf("Immune state (2), current speed %f\n", currentSpeed);
 
+        // Head away from player
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 1 : 0;
 
-                    // JUMP
-                    if (is_on_block()) {
-                        shakeOnLanding = BOSS_1_ANGRY_JUMP_SHAKE_TIME;
-                        jump(BOSS_1_ANGRY_JUMP_SPEED, BOSS_1_JUMP_COOLDOWN);
-                    }
-                }
+        bool hitWall = false;
+        for (uint16_t i = 0; i < foreground.size(); i++) {
+            if (foreground[i].y + SPRITE_SIZE > y && foreground[i].y < y + SPRITE_SIZE * 2 && (lastDirection ? x + SPRITE_SIZE * 2 - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
+                // Walked into side of block
+                hitWall = true;
+                // Break because we definitely have hit wall
+                break;
             }
-            else if (state == 1) {
-                // PURSUE
-
-                // Only go fast once on ground
-                for (uint16_t i = 0; i < foreground.size(); i++) {
-                    if (y + SPRITE_SIZE * 2 == foreground[i].y && foreground[i].x + SPRITE_SIZE - 1 > x && foreground[i].x + 1 < x + SPRITE_SIZE * 2) {
-                        // On block
-                        currentSpeed = BOSS_1_PURSUIT_SPEED;
-                    }
-                }
-
-                lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+        }
 
-                bool shouldJump = true;
+        //bool atEdge = true;
+        //float tempX = lastDirection ? x + SPRITE_SIZE * 2 : x - SPRITE_SIZE * 2;
+        //for (uint16_t i = 0; i < foreground.size(); i++) {
+        //    if (y + SPRITE_SIZE * 2 == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE * 2 - 1) {
+        //        // About to be on block
+        //        atEdge = false;
+        //        break;
+        //    }
+        //}
 
-                float tempX = lastDirection ? x + SPRITE_SIZE * 2 : x - SPRITE_SIZE * 2;
-                for (uint16_t i = 0; i < foreground.size(); i++) {
-                    if (y + SPRITE_SIZE * 2 == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE * 2 - 1) {
-                        // About to be on block
-                        shouldJump = false;
-                        break;
-                    }
-                }
-                for (uint16_t i = 0; i < foreground.size(); i++) {
-                    if ((lastDirection ? x + SPRITE_SIZE * 2 - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
-                        // Walked into side of block
-                        shouldJump = true;
-                        // Break because we definitely need to jump
-                        break;
-                    }
-                }
+        // Handle states
+        if (hitWall || /*atEdge ||*/ !is_within_range(x, *playerX, health == 0 ? BOSS_1_DEATH_MAX_RANGE : BOSS_1_INJURED_MAX_RANGE) || !is_within_range(y, *playerY, health == 0 ? BOSS_1_DEATH_MAX_RANGE : BOSS_1_INJURED_MAX_RANGE)) {
+            // NOTE: bug if you kill boss right on edge of platform or other times?
+            state = 3;
+            minionsToSpawn = 3 - health;
+            jumpCooldown = BOSS_1_MINION_SPAWN_COOLDOWN; // delay minion spawning
+        }
+    }
+    else if (state == 3) {
+        // SPAWN MINIONS
 
+        currentSpeed = 0;//BOSS_IDLE_SPEED;
 
-                if (shouldJump && !jumpCooldown) {
-                    if (is_on_block()) {
-                        shakeOnLanding = BOSS_1_JUMP_SHAKE_TIME;
-                        jump(BOSS_1_JUMP_SPEED, BOSS_1_JUMP_COOLDOWN);
-                    }
-                }
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
 
+        // Jump whenever spawn minion
+        if (!jumpCooldown && minionsToSpawn) {
+            if (is_on_block()) {
+                shakeOnLanding = BOSS_1_ANGRY_JUMP_SHAKE_TIME;
 
+                // Spawn minion
+                uint16_t minion = enemies.index_of(spawn_enemy(x + SPRITE_SIZE, y + SPRITE_SIZE, (uint8_t)enemyType));
+                enemies.lastDirection[minion] = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+                enemies.cold[minion].currentSpeed = BOSS_1_MINION_SPEED - BOSS_1_MINION_SPEED_REDUCTION * (2 - health);
+                minionsToSpawn--;
 
-                // Handle states
-                if (!is_within_range(x, *playerX, BOSS_1_IGNORE_MIN_RANGE) || !is_within_range(y, *playerY, BOSS_1_IGNORE_MIN_RANGE)) {
-                    state = 0;
-                }
-                else if (is_immune()) {
-                    state = 2;
-                    // slow down player
-                    slowPlayer = true;
-                }
+                jump(BOSS_1_ANGRY_JUMP_SPEED, BOSS_1_MINION_SPAWN_COOLDOWN);
             }
-            else if (state == 2) {
-                // IMMUNE
-
-                currentSpeed = BOSS_1_ANGRY_SPEED - BOSS_1_SPEED_REDUCTION_SCALE * get_abs_center_range(x, *playerX);
-
-                //printf("Immune state (2), current speed %f\n", currentSpeed);
-
-                // Head away from player
-                lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 1 : 0;
-
-                bool hitWall = false;
-                for (uint16_t i = 0; i < foreground.size(); i++) {
-                    if (foreground[i].y + SPRITE_SIZE > y && foreground[i].y < y + SPRITE_SIZE * 2 && (lastDirection ? x + SPRITE_SIZE * 2 - 1 : x - SPRITE_SIZE + 1) == foreground[i].x) {
-                        // Walked into side of block
-                        hitWall = true;
-                        // Break because we definitely have hit wall
-                        break;
-                    }
-                }
+        }
 
-                //bool atEdge = true;
-                //float tempX = lastDirection ? x + SPRITE_SIZE * 2 : x - SPRITE_SIZE * 2;
-                //for (uint16_t i = 0; i < foreground.size(); i++) {
-                //    if (y + SPRITE_SIZE * 2 == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE * 2 - 1) {
-                //        // About to be on block
-                //        atEdge = false;
-                //        break;
-                //    }
-                //}
+        // Handle states
+        if (!jumpCooldown && !minionsToSpawn) {
+            if (health > 0) {
+                // Not dead
+                state = 1;
+                immuneTimer = 0;
 
-                // Handle states
-                if (hitWall || /*atEdge ||*/ !is_within_range(x, *playerX, health == 0 ? BOSS_1_DEATH_MAX_RANGE : BOSS_1_INJURED_MAX_RANGE) || !is_within_range(y, *playerY, health == 0 ? BOSS_1_DEATH_MAX_RANGE : BOSS_1_INJURED_MAX_RANGE)) {
-                    // NOTE: bug if you kill boss right on edge of platform or other times?
-                    state = 3;
-                    minionsToSpawn = 3 - health;
-                    jumpCooldown = BOSS_1_MINION_SPAWN_COOLDOWN; // delay minion spawning
-                }
+                // Unslow player
+                slowPlayer = false;
             }
-            else if (state == 3) {
-                // SPAWN MINIONS
-
-                currentSpeed = 0;//BOSS_IDLE_SPEED;
-
-                lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
-
-                // Jump whenever spawn minion
-                if (!jumpCooldown && minionsToSpawn) {
-                    if (is_on_block()) {
-                        shakeOnLanding = BOSS_1_ANGRY_JUMP_SHAKE_TIME;
-
-                        // Spawn minion
-                        enemies.push_back(Enemy(x + SPRITE_SIZE, y + SPRITE_SIZE, enemyHealths[(uint8_t)enemyType], (uint8_t)enemyType));
-                        enemies[enemies.size() - 1].lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
-                        enemies[enemies.size() - 1].set_speed(BOSS_1_MINION_SPEED - BOSS_1_MINION_SPEED_REDUCTION * (2 - health));
-                        minionsToSpawn--;
-
-                        jump(BOSS_1_ANGRY_JUMP_SPEED, BOSS_1_MINION_SPAWN_COOLDOWN);
-                    }
-                }
-
-                // Handle states
-                if (!jumpCooldown && !minionsToSpawn) {
-                    if (health > 0) {
-                        // Not dead
-                        state = 1;
-                        immuneTimer = 0;
-
-                        // Unslow player
-                        slowPlayer = false;
-                    }
-                    else {
-                        // Dead
-                        // Generate particles
-                        particles = generate_particles(x + SPRITE_SIZE, y + SPRITE_SIZE, BOSS_DEATH_PARTICLE_GRAVITY_X, BOSS_DEATH_PARTICLE_GRAVITY_Y, bossDeathParticleColours[(uint8_t)enemyType], BOSS_DEATH_PARTICLE_SPEED, BOSS_DEATH_PARTICLE_COUNT);
-                        deathParticles = true;
-                        state = 4;
-                        dead = true;
-                        // Play death sfx
-                        audioHandler.play(3);
-                    }
-                }
+            else {
+                // Dead
+                // Generate particles
+                particles = generate_particles(x + SPRITE_SIZE, y + SPRITE_SIZE, BOSS_DEATH_PARTICLE_GRAVITY_X, BOSS_DEATH_PARTICLE_GRAVITY_Y, bossDeathParticleColours[(uint8_t)enemyType], BOSS_DEATH_PARTICLE_SPEED, BOSS_DEATH_PARTICLE_COUNT);
+                deathParticles = true;
+                state = 4;
+                dead = true;
+                // Play death sfx
+                audioHandler.play(3);
             }
-            else if (state == 4) {
-                // Dead, displaying particles
-
-                if (deathParticles) {
-                    if (particles.size() == 0) {
-                        // No particles left
-                        deathParticles = false;
+        }
+    }
+    else if (state == 4) {
+        // Dead, displaying particles
 
-                        // Unslow player
-                        slowPlayer = false;
-                    }
-                    else {
-                        for (uint8_t i = 0; i < particles.size(); i++) {
-                            particles[i].update(dt);
-                        }
+        if (deathParticles) {
+            if (particles.size() == 0) {
+                // No particles left
+                deathParticles = false;
 
-                        // Remove any particles which are too old
-                        particles.erase(std::remove_if(particles.begin(), particles.end(), [](Particle particle) { return (particle.age >= BOSS_DEATH_PARTICLE_AGE); }), particles.end());
-                    }
+                // Unslow player
+                slowPlayer = false;
+            }
+            else {
+                for (uint8_t i = 0; i < particles.size(); i++) {
+                    particles[i].update(dt, camera);
                 }
+
+                // Remove any particles which are too old
+                particles.erase(std::remove_if(particles.begin(), particles.end(), [](Particle particle) { return (particle.age >= BOSS_DEATH_PARTICLE_AGE); }), particles.end());
             }
         }
-        else if (enemyType == EnemyType::RANGED) {
-            update_collisions();
+    }
+}
 
-            if (state == 0) {
-                // IDLE
-                currentSpeed = 0;
+template<>
+void Boss::update_behaviour<EnemyType::RANGED>(float dt) {
+    update_collisions();
+
+    if (state == 0) {
+        // IDLE
+        currentSpeed = 0;
 
-                lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
 
-                // Handle states
-                if (is_within_range(x, *playerX, BOSS_2_JUMP_TRIGGER_MAX_RANGE) && is_within_range(y, *playerY, BOSS_2_JUMP_TRIGGER_MAX_RANGE)) {
-                    state = 1;
-                    bossBattle = true;
+        // Handle states
+        if (is_within_range(x, *playerX, BOSS_2_JUMP_TRIGGER_MAX_RANGE) && is_within_range(y, *playerY, BOSS_2_JUMP_TRIGGER_MAX_RANGE)) {
+            state = 1;
+            bossBattle = true;
 
-                    lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+            lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
 
-                    // JUMP
-                    if (is_on_block()) {
-                        shakeOnLanding = BOSS_2_ANGRY_JUMP_SHAKE_TIME;
-                        jump(BOSS_2_ANGRY_JUMP_SPEED, BOSS_2_JUMP_COOLDOWN);
-                    }
-                }
+            // JUMP
+            if (is_on_block()) {
+                shakeOnLanding = BOSS_2_ANGRY_JUMP_SHAKE_TIME;
+                jump(BOSS_2_ANGRY_JUMP_SPEED, BOSS_2_JUMP_COOLDOWN);
             }
-            else if (state == 1) {
-                lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+        }
+    }
+    else if (state == 1) {
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
 
-                if (!reloadTimer) {
-                    // Fire!
-                    float xV = (*playerX - x) / BOSS_2_PROJECTILE_FLIGHT_TIME;
-                    // yVel is broken
-                    float yV = ((*playerY - y) / BOSS_2_PROJECTILE_FLIGHT_TIME) - 0.5f * PROJECTILE_GRAVITY * BOSS_2_PROJECTILE_FLIGHT_TIME;
+        if (!reloadTimer) {
+            // Fire!
+            float xV = (*playerX - x) / BOSS_2_PROJECTILE_FLIGHT_TIME;
+            // yVel is broken
+            float yV = ((*playerY - y) / BOSS_2_PROJECTILE_FLIGHT_TIME) - 0.5f * PROJECTILE_GRAVITY * BOSS_2_PROJECTILE_FLIGHT_TIME;
 
-                    //x,y should be offset to center
-                    projectiles.push_back(Projectile(x + SPRITE_SIZE, y + SPRITE_SIZE, xV, yV, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_BOSS_PROJECTILE_SNOWBALL : TILE_ID_BOSS_PROJECTILE_ROCK, true, SPRITE_SIZE));
-                    reloadTimer = BOSS_2_RELOAD_TIME;
+            //x,y should be offset to center
+            spawn_projectile(x + SPRITE_SIZE, y + SPRITE_SIZE, xV, yV, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_BOSS_PROJECTILE_SNOWBALL : TILE_ID_BOSS_PROJECTILE_ROCK, true, SPRITE_SIZE);
+            reloadTimer = BOSS_2_RELOAD_TIME;
 
-                    audioHandler.play(6);
-                }
+            audioHandler.play(6);
+        }
+
+        // Handle states
+        if (!is_within_range(x, *playerX, BOSS_2_IGNORE_MIN_RANGE) || !is_within_range(y, *playerY, BOSS_2_IGNORE_MIN_RANGE)) {
+            state = 0;
+        }
+        else if (is_immune()) {
+            if (health == 0) {
+                state = 3;
 
-                // Handle states
-                if (!is_within_range(x, *playerX, BOSS_2_IGNORE_MIN_RANGE) || !is_within_range(y, *playerY, BOSS_2_IGNORE_MIN_RANGE)) {
-                    state = 0;
+                // JUMP
+                if (is_on_block()) {
+                    shakeOnLanding = BOSS_2_ANGRY_JUMP_SHAKE_TIME;
+                    jump(BOSS_2_ANGRY_JUMP_SPEED, BOSS_2_JUMP_COOLDOWN);
                 }
-                else if (is_immune()) {
-                    if (health == 0) {
-                        state = 3;
-
-                        // JUMP
-                        if (is_on_block()) {
-                            shakeOnLanding = BOSS_2_ANGRY_JUMP_SHAKE_TIME;
-                            jump(BOSS_2_ANGRY_JUMP_SPEED, BOSS_2_JUMP_COOLDOWN);
-                        }
 
-                        shotsLeft = BOSS_2_RAPID_SHOT_COUNT * 3;
+                shotsLeft = BOSS_2_RAPID_SHOT_COUNT * 3;
 
-                        // Make player drop through floor
-                        dropPlayer = true;
-                    }
-                    else {
-                        state = 2;
+                // Make player drop through floor
+                dropPlayer = true;
+            }
+            else {
+                state = 2;
 
-                        // JUMP
-                        if (is_on_block()) {
-                            shakeOnLanding = BOSS_2_ANGRY_JUMP_SHAKE_TIME;
-                            jump(BOSS_2_ANGRY_JUMP_SPEED, BOSS_2_JUMP_COOLDOWN);
-                        }
+                // JUMP
+                if (is_on_block()) {
+                    shakeOnLanding = BOSS_2_ANGRY_JUMP_SHAKE_TIME;
+                    jump(BOSS_2_ANGRY_JUMP_SPEED, BOSS_2_JUMP_COOLDOWN);
+                }
 
-                        shotsLeft = BOSS_2_RAPID_SHOT_COUNT + (3 - health);
+                shotsLeft = BOSS_2_RAPID_SHOT_COUNT + (3 - health);
 
-                        // Make player drop through floor
-                        dropPlayer = true;
-                    }
-                }
+                // Make player drop through floor
+                dropPlayer = true;
             }
-            else if (state == 2) {
-                lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+        }
+    }
+    else if (state == 2) {
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
 
-                if (is_on_block()) {
-                    if (shotsLeft && !reloadTimer) {
-                        // Fire!
-                        float xV = ((*playerX - x) / BOSS_2_RAPID_PROJECTILE_FLIGHT_TIME) * (1.15f - shotsLeft / 20);
-                        // yVel is broken
-                        float yV = ((*playerY - y) / BOSS_2_RAPID_PROJECTILE_FLIGHT_TIME) - 0.5f * PROJECTILE_GRAVITY * BOSS_2_RAPID_PROJECTILE_FLIGHT_TIME;
+        if (is_on_block()) {
+            if (shotsLeft && !reloadTimer) {
+                // Fire!
+                float xV = ((*playerX - x) / BOSS_2_RAPID_PROJECTILE_FLIGHT_TIME) * (1.15f - shotsLeft / 20);
+                // yVel is broken
+                float yV = ((*playerY - y) / BOSS_2_RAPID_PROJECTILE_FLIGHT_TIME) - 0.5f * PROJECTILE_GRAVITY * BOSS_2_RAPID_PROJECTILE_FLIGHT_TIME;
 
-                        //x,y should be offset to center
-                        projectiles.push_back(Projectile(x + SPRITE_SIZE, y + SPRITE_SIZE, xV, yV, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_BOSS_PROJECTILE_SNOWBALL : TILE_ID_BOSS_PROJECTILE_ROCK, true, SPRITE_SIZE));
-                        reloadTimer = BOSS_2_RAPID_RELOAD_TIME;
+                //x,y should be offset to center
+                spawn_projectile(x + SPRITE_SIZE, y + SPRITE_SIZE, xV, yV, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_BOSS_PROJECTILE_SNOWBALL : TILE_ID_BOSS_PROJECTILE_ROCK, true, SPRITE_SIZE);
+                reloadTimer = BOSS_2_RAPID_RELOAD_TIME;
 
-                        audioHandler.play(6);
+                audioHandler.play(6);
 
-                        shotsLeft--;
-                    }
-                }
-                
-                if (!shotsLeft && !reloadTimer) {
-                    // Not dead
-                    state = 0;
-                    immuneTimer = 0;
-                    reloadTimer = BOSS_2_RESET_COOLDOWN;
-
-                    // Unslow player
-                    slowPlayer = false;
-                }
+                shotsLeft--;
             }
-            else if (state == 3) {
-                lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+        }
 
-                if (is_on_block()) {
-                    if (shotsLeft && !reloadTimer) {
-                        // Fire!
-                        float tX = x - (SPRITE_SIZE * BOSS_2_RAPID_SHOT_COUNT * 3) + SPRITE_SIZE * shotsLeft * 2;
-                        float xV = ((tX - x) / BOSS_2_SUPER_RAPID_PROJECTILE_FLIGHT_TIME);
-                        // yVel is broken
-                        float yV = ((*playerY - y) / BOSS_2_SUPER_RAPID_PROJECTILE_FLIGHT_TIME) - 0.5f * PROJECTILE_GRAVITY * BOSS_2_SUPER_RAPID_PROJECTILE_FLIGHT_TIME;
+        if (!shotsLeft && !reloadTimer) {
+            // Not dead
+            state = 0;
+            immuneTimer = 0;
+            reloadTimer = BOSS_2_RESET_COOLDOWN;
+
+            // Unslow player
+            slowPlayer = false;
+        }
+    }
+    else if (state == 3) {
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
 
-                        //x,y should be offset to center
-                        projectiles.push_back(Projectile(x, y, xV, yV, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_BOSS_PROJECTILE_SNOWBALL : TILE_ID_BOSS_PROJECTILE_ROCK, true, SPRITE_SIZE));
-                        reloadTimer = BOSS_2_SUPER_RAPID_RELOAD_TIME;
+        if (is_on_block()) {
+            if (shotsLeft && !reloadTimer) {
+                // Fire!
+                float tX = x - (SPRITE_SIZE * BOSS_2_RAPID_SHOT_COUNT * 3) + SPRITE_SIZE * shotsLeft * 2;
+                float xV = ((tX - x) / BOSS_2_SUPER_RAPID_PROJECTILE_FLIGHT_TIME);
+                // yVel is broken
+                float yV = ((*playerY - y) / BOSS_2_SUPER_RAPID_PROJECTILE_FLIGHT_TIME) - 0.5f * PROJECTILE_GRAVITY * BOSS_2_SUPER_RAPID_PROJECTILE_FLIGHT_TIME;
 
-                        audioHandler.play(6);
+                //x,y should be offset to center
+                spawn_projectile(x, y, xV, yV, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_BOSS_PROJECTILE_SNOWBALL : TILE_ID_BOSS_PROJECTILE_ROCK, true, SPRITE_SIZE);
+                reloadTimer = BOSS_2_SUPER_RAPID_RELOAD_TIME;
 
-                        shotsLeft--;
-                    }
-                }
+                audioHandler.play(6);
 
-                if (!shotsLeft && !reloadTimer) {
-                    // Dead
-                    // Generate particles
-                    particles = generate_particles(x + SPRITE_SIZE, y + SPRITE_SIZE, BOSS_DEATH_PARTICLE_GRAVITY_X, BOSS_DEATH_PARTICLE_GRAVITY_Y, bossDeathParticleColours[(uint8_t)enemyType], BOSS_DEATH_PARTICLE_SPEED, BOSS_DEATH_PARTICLE_COUNT);
-                    deathParticles = true;
-                    state = 4;
-                    dead = true;
-                    // Play death sfx
-                    audioHandler.play(3);
-                }
+                shotsLeft--;
             }
-            else if (state == 4) {
-                // Dead, displaying particles
+        }
 
-                if (deathParticles) {
-                    if (particles.size() == 0) {
-                        // No particles left
-                        deathParticles = false;
+        if (!shotsLeft && !reloadTimer) {
+            // Dead
+            // Generate particles
+            particles = generate_particles(x + SPRITE_SIZE, y + SPRITE_SIZE, BOSS_DEATH_PARTICLE_GRAVITY_X, BOSS_DEATH_PARTICLE_GRAVITY_Y, bossDeathParticleColours[(uint8_t)enemyType], BOSS_DEATH_PARTICLE_SPEED, BOSS_DEATH_PARTICLE_COUNT);
+            deathParticles = true;
+            state = 4;
+            dead = true;
+            // Play death sfx
+            audioHandler.play(3);
+        }
+    }
+    else if (state == 4) {
+        // Dead, displaying particles
 
-                        // Unslow player
-                        slowPlayer = false;
-                    }
-                    else {
-                        for (uint8_t i = 0; i < particles.size(); i++) {
-                            particles[i].update(dt);
-                        }
+        if (deathParticles) {
+            if (particles.size() == 0) {
+                // No particles left
+                deathParticles = false;
 
-                        // Remove any particles which are too old
-                        particles.erase(std::remove_if(particles.begin(), particles.end(), [](Particle particle) { return (particle.age >= BOSS_DEATH_PARTICLE_AGE); }), particles.end());
-                    }
-                }
-            }
-        }
-        else if (enemyType == EnemyType::PURSUIT) {
-            // Use persuit tag for giant boss, even though it's more like a BASIC v2.0
-            if (lastDirection) {
-                xVel = currentSpeed;
+                // Unslow player
+                slowPlayer = false;
             }
             else {
-                xVel = -currentSpeed;
+                for (uint8_t i = 0; i < particles.size(); i++) {
+                    particles[i].update(dt, camera);
+                }
+
+                // Remove any particles which are too old
+                particles.erase(std::remove_if(particles.begin(), particles.end(), [](Particle particle) { return (particle.age >= BOSS_DEATH_PARTICLE_AGE); }), particles.end());
             }
+        }
+    }
+}
 
-            update_collisions();
+// Use persuit tag for giant boss, even though it's more like a BASIC v2.0
+template<>
+void Boss::update_behaviour<EnemyType::PURSUIT>(float dt) {
+    if (lastDirection) {
+        xVel = currentSpeed;
+    }
+    else {
+        xVel = -currentSpeed;
+    }
 
-            if (state == 0) {
-                // IDLE
+    update_collisions();
 
-                if (is_within_range(x, spawnX, BIG_BOSS_RETURN_TO_SPAWN_RANGE)) {
-                    // Wait
-                    currentSpeed = 0;
+    if (state == 0) {
+        // IDLE
 
-                    lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
-                }
-                else {
-                    // Return to spawn
-                    currentSpeed = BIG_BOSS_IDLE_SPEED;
+        if (is_within_range(x, spawnX, BIG_BOSS_RETURN_TO_SPAWN_RANGE)) {
+            // Wait
+            currentSpeed = 0;
 
-                    lastDirection = spawnX < x + SPRITE_SIZE * 2 ? 0 : 1;
-                }
+            lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
+        }
+        else {
+            // Return to spawn
+            currentSpeed = BIG_BOSS_IDLE_SPEED;
 
+            lastDirection = get_direction_to_spawn();
+        }
 
-                // Handle states
-                if (is_within_range(x, *playerX, BIG_BOSS_JUMP_TRIGGER_MAX_RANGE) && is_within_range(y, *playerY, BIG_BOSS_JUMP_TRIGGER_MAX_RANGE)) {
-                    state = 1;
-                    bossBattle = true;
 
-                    lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
+        // Handle states
+        if (is_within_range(x, *playerX, BIG_BOSS_JUMP_TRIGGER_MAX_RANGE) && is_within_range(y, *playerY, BIG_BOSS_JUMP_TRIGGER_MAX_RANGE)) {
+            state = 1;
+            bossBattle = true;
 
-                    shotsLeft = 0;
+            lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
 
+            shotsLeft = 0;
 
-                    // JUMP
-                    if (is_on_block()) {
-                        shakeOnLanding = BIG_BOSS_ANGRY_JUMP_SHAKE_TIME;
-                        jump(BIG_BOSS_ANGRY_JUMP_SPEED, BIG_BOSS_JUMP_COOLDOWN);
-                    }
-                }
+
+            // JUMP
+            if (is_on_block()) {
+                shakeOnLanding = BIG_BOSS_ANGRY_JUMP_SHAKE_TIME;
+                jump(BIG_BOSS_ANGRY_JUMP_SPEED, BIG_BOSS_JUMP_COOLDOWN);
             }
-            else if (state == 1) {
-                // PURSUE
+        }
+    }
+    else if (state == 1) {
+        // PURSUE
 
-                if ((*playerY < y - SPRITE_SIZE * 4 && std::abs((*playerX + SPRITE_HALF) - (x + SPRITE_SIZE * 2)) < SPRITE_SIZE * 6) || std::abs((*playerX + SPRITE_HALF) - (x + SPRITE_SIZE * 2)) > SPRITE_SIZE * 9) {
-                    // Player is a bit above boss, FIRE!
-                    currentSpeed = 0;
+        if ((*playerY < y - SPRITE_SIZE * 4 && std::abs((*playerX + SPRITE_HALF) - (x + SPRITE_SIZE * 2)) < SPRITE_SIZE * 6) || std::abs((*playerX + SPRITE_HALF) - (x + SPRITE_SIZE * 2)) > SPRITE_SIZE * 9) {
+            // Player is a bit above boss, FIRE!
+            currentSpeed = 0;
 
-                    lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
+            lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
 
-                    if (!reloadTimer && !shotsLeft) {
-                        shotsLeft = 3;
-                    }
+            if (!reloadTimer && !shotsLeft) {
+                shotsLeft = 3;
+            }
 
-                    if (is_on_block()) {
-                        if (!rapidfireTimer && shotsLeft) {
-                            // Fire!
-                            float xV = ((*playerX - x - SPRITE_HALF * 3) / BIG_BOSS_PROJECTILE_FLIGHT_TIME) * (1.1f - shotsLeft / 20);
-                            // yVel is broken
-                            float yV = ((*playerY - y - SPRITE_HALF * 3) / BIG_BOSS_PROJECTILE_FLIGHT_TIME) - 0.5f * PROJECTILE_GRAVITY * BIG_BOSS_PROJECTILE_FLIGHT_TIME;
+            if (is_on_block()) {
+                if (!rapidfireTimer && shotsLeft) {
+                    // Fire!
+                    float xV = ((*playerX - x - SPRITE_HALF * 3) / BIG_BOSS_PROJECTILE_FLIGHT_TIME) * (1.1f - shotsLeft / 20);
+                    // yVel is broken
+                    float yV = ((*playerY - y - SPRITE_HALF * 3) / BIG_BOSS_PROJECTILE_FLIGHT_TIME) - 0.5f * PROJECTILE_GRAVITY * BIG_BOSS_PROJECTILE_FLIGHT_TIME;
 
-                            // x,y are offset to center
-                            projectiles.push_back(Projectile(x + SPRITE_SIZE * 2, y + SPRITE_SIZE, xV, yV, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_BOSS_PROJECTILE_SNOWBALL : TILE_ID_BOSS_PROJECTILE_ROCK, true, SPRITE_SIZE));
-                            
-                            rapidfireTimer = BIG_BOSS_RAPID_RELOAD_TIME;
-                            shotsLeft--;
+                    // x,y are offset to center
+                    spawn_projectile(x + SPRITE_SIZE * 2, y + SPRITE_SIZE, xV, yV, currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8 ? TILE_ID_BOSS_PROJECTILE_SNOWBALL : TILE_ID_BOSS_PROJECTILE_ROCK, true, SPRITE_SIZE);
 
-                            audioHandler.play(6);
-                        }
-                    }
+                    rapidfireTimer = BIG_BOSS_RAPID_RELOAD_TIME;
+                    shotsLeft--;
 
-                    if (!shotsLeft && !reloadTimer) {
-                        reloadTimer = BIG_BOSS_RELOAD_TIME;
-                    }
+                    audioHandler.play(6);
                 }
-                else if (std::abs((*playerX + SPRITE_HALF) - (x + SPRITE_SIZE * 2)) > SPRITE_SIZE * 4 && !reloadTimer) {
-                    // Only go fast once on ground
-                    if (is_on_block()) {
-                        currentSpeed = BIG_BOSS_PURSUIT_SPEED;
-                    }
+            }
 
-                    lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
+            if (!shotsLeft && !reloadTimer) {
+                reloadTimer = BIG_BOSS_RELOAD_TIME;
+            }
+        }
+        else if (std::abs((*playerX + SPRITE_HALF) - (x + SPRITE_SIZE * 2)) > SPRITE_SIZE * 4 && !reloadTimer) {
+            // Only go fast once on ground
+            if (is_on_block()) {
+                currentSpeed = BIG_BOSS_PURSUIT_SPEED;
+            }
 
-                    bool shouldStop = true;
+            lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
 
-                    float tempX = lastDirection ? x + SPRITE_SIZE * 2 : x - SPRITE_SIZE * 2;
-                    for (uint16_t i = 0; i < foreground.size(); i++) {
-                        if (y + SPRITE_SIZE * 4 == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE * 4 - 1) {
-                            // About to be on block
-                            shouldStop = false;
-                            break;
-                        }
-                    }
-                    if (shouldStop) {
-                        currentSpeed = 0;
-                    }
-                }
-                else if (std::abs((*playerX + SPRITE_HALF) - (x + SPRITE_SIZE * 2)) < SPRITE_SIZE * 5 && *playerY > y) {
-                    // Only go fast once on ground
-                    if (is_on_block()) {
-                        currentSpeed = BIG_BOSS_PURSUIT_SPEED;
-
-                        if (!jumpCooldown) {
-                            shakeOnLanding = BIG_BOSS_JUMP_SHAKE_TIME;
-                            jump(BIG_BOSS_JUMP_SPEED, BIG_BOSS_JUMP_COOLDOWN);
-                        }
-                    }
-                }
-                else {
-                    currentSpeed = 0;
-                }
+            bool shouldStop = true;
 
-                // Handle states
-                if (!is_within_range(x, *playerX, BIG_BOSS_IGNORE_MIN_RANGE) || !is_within_range(y, *playerY, BIG_BOSS_IGNORE_MIN_RANGE)) {
-                    state = 0;
-                }
-                else if (is_immune()) {
-                    state = 2;
-                    // slow down player
-                    //slowPlayer = true;
+            float tempX = lastDirection ? x + SPRITE_SIZE * 2 : x - SPRITE_SIZE * 2;
+            for (uint16_t i = 0; i < foreground.size(); i++) {
+                if (y + SPRITE_SIZE * 4 == foreground[i].y && foreground[i].x + SPRITE_SIZE > tempX + 1 && foreground[i].x < tempX + SPRITE_SIZE * 4 - 1) {
+                    // About to be on block
+                    shouldStop = false;
+                    break;
                 }
             }
-            else if (state == 2) {
-                // SELF DEFENCE
+            if (shouldStop) {
+                currentSpeed = 0;
+            }
+        }
+        else if (std::abs((*playerX + SPRITE_HALF) - (x + SPRITE_SIZE * 2)) < SPRITE_SIZE * 5 && *playerY > y) {
+            // Only go fast once on ground
+            if (is_on_block()) {
+                currentSpeed = BIG_BOSS_PURSUIT_SPEED;
 
-                // Push player away, in direction of spawn (i.e. furthest distance)
+                if (!jumpCooldown) {
+                    shakeOnLanding = BIG_BOSS_JUMP_SHAKE_TIME;
+                    jump(BIG_BOSS_JUMP_SPEED, BIG_BOSS_JUMP_COOLDOWN);
+                }
+            }
+        }
+        else {
+            currentSpeed = 0;
+        }
 
-                lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 1 : 0;
+        // Handle states
+        if (!is_within_range(x, *playerX, BIG_BOSS_IGNORE_MIN_RANGE) || !is_within_range(y, *playerY, BIG_BOSS_IGNORE_MIN_RANGE)) {
+            state = 0;
+        }
+        else if (is_immune()) {
+            state = 2;
+            // slow down player
+            //slowPlayer = true;
+        }
+    }
+    else if (state == 2) {
+        // SELF DEFENCE
 
-                repelPlayer = true;
+        // Push player away, in direction of spawn (i.e. furthest distance)
 
-                currentSpeed = BIG_BOSS_RETREAT_SPEED;
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 1 : 0;
 
-                // Handle states
-                if (!is_within_range(x, *playerX, BIG_BOSS_INJURED_MAX_RANGE) || !is_within_range(y, *playerY, BIG_BOSS_INJURED_MAX_RANGE)) {
-                    state = 3;
-                    minionsToSpawn = 1;
-                    repelPlayer = false;
-                }
+        repelPlayer = true;
 
-            }
-            else if (state == 3) {
-                // SPAWN MINIONS
+        currentSpeed = BIG_BOSS_RETREAT_SPEED;
 
-                currentSpeed = 0;
+        // Handle states
+        if (!is_within_range(x, *playerX, BIG_BOSS_INJURED_MAX_RANGE) || !is_within_range(y, *playerY, BIG_BOSS_INJURED_MAX_RANGE)) {
+            state = 3;
+            minionsToSpawn = 1;
+            repelPlayer = false;
+        }
 
-                lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
+    }
+    else if (state == 3) {
+        // SPAWN MINIONS
 
-                // Jump whenever spawn minion
-                if (!jumpCooldown && minionsToSpawn) {
-                    if (is_on_block()) {
-                        shakeOnLanding = BIG_BOSS_ANGRY_JUMP_SHAKE_TIME;
+        currentSpeed = 0;
 
-                        // Spawn minion
-                        enemies.push_back(Enemy(x + SPRITE_SIZE * 2, y + SPRITE_SIZE * 2, enemyHealths[bigBossMinions[health]], bigBossMinions[health]));
-                        enemies[enemies.size() - 1].lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
-                        enemies[enemies.size() - 1].set_player_position(playerX, playerY);
-                        //enemies[enemies.size() - 1].set_speed(BIG_BOSS_MINION_SPEED - BIG_BOSS_MINION_SPEED_REDUCTION * (2 - health));
-                        minionsToSpawn--;
+        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
 
-                        jump(BIG_BOSS_ANGRY_JUMP_SPEED, BIG_BOSS_MINION_SPAWN_COOLDOWN);
-                    }
-                }
+        // Jump whenever spawn minion
+        if (!jumpCooldown && minionsToSpawn) {
+            if (is_on_block()) {
+                shakeOnLanding = BIG_BOSS_ANGRY_JUMP_SHAKE_TIME;
 
-                // Handle states
-                if (!jumpCooldown && !minionsToSpawn) {
-                    if (health > 0) {
-                        // Not dead
-                        state = 1;
-                        immuneTimer = 0;
+                // Spawn minion
+                uint16_t minion = enemies.index_of(spawn_enemy(x + SPRITE_SIZE * 2, y + SPRITE_SIZE * 2, bigBossMinions[health]));
+                enemies.lastDirection[minion] = *playerX + SPRITE_HALF < x + SPRITE_SIZE * 2 ? 0 : 1;
+                //enemies.cold[minion].currentSpeed = BIG_BOSS_MINION_SPEED - BIG_BOSS_MINION_SPEED_REDUCTION * (2 - health);
+                minionsToSpawn--;
 
-                        // Unslow player
-                        slowPlayer = false;
-                    }
-                    else {
-                        // Dead
-                        // Generate particles
-                        particles = generate_particles(x + SPRITE_SIZE * 2, y + SPRITE_SIZE * 2, BOSS_DEATH_PARTICLE_GRAVITY_X, BOSS_DEATH_PARTICLE_GRAVITY_Y, bossDeathParticleColours[(uint8_t)enemyType], BOSS_DEATH_PARTICLE_SPEED, BOSS_DEATH_PARTICLE_COUNT);
-                        deathParticles = true;
-                        state = 4;
-                        dead = true;
-                        // Play death sfx
-                        audioHandler.play(3);
-                    }
-                }
+                jump(BIG_BOSS_ANGRY_JUMP_SPEED, BIG_BOSS_MINION_SPAWN_COOLDOWN);
             }
-            else if (state == 4) {
-                // Dead, displaying particles
-
-                if (deathParticles) {
-                    if (particles.size() == 0) {
-                        // No particles left
-                        deathParticles = false;
+        }
 
-                        // Unslow player
-                        slowPlayer = false;
-                    }
-                    else {
-                        for (uint8_t i = 0; i < particles.size(); i++) {
-                            particles[i].update(dt);
-                        }
+        // Handle states
+        if (!jumpCooldown && !minionsToSpawn) {
+            if (health > 0) {
+                // Not dead
+                state = 1;
+                immuneTimer = 0;
 
-                        // Remove any particles which are too old
-                        particles.erase(std::remove_if(particles.begin(), particles.end(), [](Particle particle) { return (particle.age >= BOSS_DEATH_PARTICLE_AGE); }), particles.end());
-                    }
-                }
+                // Unslow player
+                slowPlayer = false;
+            }
+            else {
+                // Dead
+                // Generate particles
+                particles = generate_particles(x + SPRITE_SIZE * 2, y + SPRITE_SIZE * 2, BOSS_DEATH_PARTICLE_GRAVITY_X, BOSS_DEATH_PARTICLE_GRAVITY_Y, bossDeathParticleColours[(uint8_t)enemyType], BOSS_DEATH_PARTICLE_SPEED, BOSS_DEATH_PARTICLE_COUNT);
+                deathParticles = true;
+                state = 4;
+                dead = true;
+                // Play death sfx
+                audioHandler.play(3);
             }
-        }
-
-        if (y > levelDeathBoundary) {
-            health = 0;
-            xVel = yVel = 0;
         }
     }
+    else if (state == 4) {
+        // Dead, displaying particles
 
-    bool is_on_block() {
-        if (is_big()) {
-            // Allow boss to jump on tiles
-            for (uint16_t i = 0; i < foreground.size(); i++) {
-                if (y + SPRITE_SIZE * 4 == foreground[i].y && foreground[i].x + SPRITE_SIZE - 1 > x && foreground[i].x + 1 < x + SPRITE_SIZE * 4) {
-                    // On top of block
-                    return true;
-                }
-            }
+        if (deathParticles) {
+            if (particles.size() == 0) {
+                // No particles left
+                deathParticles = false;
 
-            // Allow boss to jump on platforms
-            for (uint16_t i = 0; i < platforms.size(); i++) {
-                if (y + SPRITE_SIZE * 4 == platforms[i].y && platforms[i].x + SPRITE_SIZE - 1 > x && platforms[i].x + 1 < x + SPRITE_SIZE * 4) {
-                    // On top of block
-                    return true;
-                }
+                // Unslow player
+                slowPlayer = false;
             }
-        }
-        else {
-            // Allow boss to jump on tiles
-            for (uint16_t i = 0; i < foreground.size(); i++) {
-                if (y + SPRITE_SIZE * 2 == foreground[i].y && foreground[i].x + SPRITE_SIZE - 1 > x && foreground[i].x + 1 < x + SPRITE_SIZE * 2) {
-                    // On top of block
-                    return true;
+            else {
+                for (uint8_t i = 0; i < particles.size(); i++) {
+                    particles[i].update(dt, camera);
                 }
-            }
 
-            // Allow boss to jump on platforms
-            for (uint16_t i = 0; i < platforms.size(); i++) {
-                if (y + SPRITE_SIZE * 2 == platforms[i].y && platforms[i].x + SPRITE_SIZE - 1 > x && platforms[i].x + 1 < x + SPRITE_SIZE * 2) {
-                    // On top of block
-                    return true;
-                }
+                // Remove any particles which are too old
+                particles.erase(std::remove_if(particles.begin(), particles.end(), [](Particle particle) { return (particle.age >= BOSS_DEATH_PARTICLE_AGE); }), particles.end());
             }
         }
-
-        // Boss didn't jump
-        return false;
-
     }
+}
 
-    void set_immune() {
-        immuneTimer = BOSS_IMMUNE_TIME;
-        lastDirection = *playerX + SPRITE_HALF < x + SPRITE_SIZE ? 0 : 1;
+void Boss::update(float dt, ButtonStates buttonStates) {
+    if (jumpCooldown) {
+        jumpCooldown -= dt;
+        if (jumpCooldown < 0) {
+            jumpCooldown = 0;
+        }
     }
 
-    bool is_immune() {
-        if (enemyType == EnemyType::BASIC) {
-            return Entity::is_immune() || state >= 2;
-        }
-        else if (enemyType == EnemyType::RANGED) {
-            return Entity::is_immune() || state >= 2;
-        }
-        else if (enemyType == EnemyType::PURSUIT) {
-            return Entity::is_immune() || state >= 2;
-        }
-        else {
-            // Catch-all
-            return false;
+    if (injuredTimer) {
+        injuredTimer -= dt;
+        if (injuredTimer < 0) {
+            injuredTimer = 0;
         }
     }
 
-    void set_injured() {
-        injuredTimer = BOSS_INJURED_TIME;
-        set_immune();
+    if (immuneTimer) {
+        immuneTimer -= dt;
+        if (immuneTimer < 0) {
+            immuneTimer = 0;
+        }
     }
 
-    uint8_t get_size() {
-        if (is_big()) {
-            return SPRITE_SIZE * 4;
-        }
-        else {
-            return SPRITE_SIZE * 2;
+    if (reloadTimer) {
+        reloadTimer -= dt;
+        if (reloadTimer < 0) {
+            reloadTimer = 0;
         }
     }
 
-    bool is_big() {
-        return enemyType == EnemyType::PURSUIT;
+    if (rapidfireTimer) {
+        rapidfireTimer -= dt;
+        if (rapidfireTimer < 0) {
+            rapidfireTimer = 0;
+        }
     }
 
-    bool is_within_range(float me, float them, float range) {
-        //return get_range(me, them) < range;
-        return get_abs_center_range(me, them) < range;
+    if (enemyType == EnemyType::BASIC) {
+        update_behaviour<EnemyType::BASIC>(dt);
     }
-
-    //float get_range(float me, float them) {
-    //    if (them > me) {
-    //        // They are right
-    //        return them - (me + SPRITE_SIZE * 2);
-    //    }
-    //    else {
-    //        // They are left
-    //        return me - (them + SPRITE_SIZE);
-    //    }
-    //}
-
-    float get_center_range(float me, float them) {
-        return (me + SPRITE_SIZE) - (them + SPRITE_HALF);
+    else if (enemyType == EnemyType::RANGED) {
+        update_behaviour<EnemyType::RANGED>(dt);
     }
-
-    float get_abs_center_range(float me, float them) {
-        return std::abs(get_center_range(me, them));
+    else if (enemyType == EnemyType::PURSUIT) {
+        update_behaviour<EnemyType::PURSUIT>(dt);
     }
 
-    void update_collisions() {
-        if (!locked) {
-            // Update gravity
-            yVel += GRAVITY * dt;
-            yVel = std::min(yVel, (float)GRAVITY_MAX);
+    if (y > levelDeathBoundary) {
+        health = 0;
+        xVel = yVel = 0;
+    }
+}
 
-            // Move entity y
-            y += yVel * dt;
+std::vector<Boss> bosses; // used for levels where there is a boss.
 
-            // Here check collisions...
-            for (uint16_t i = 0; i < foreground.size(); i++) {
-                if (colliding(foreground[i])) {
-                    if (yVel > 0) {
-                        // Collided from top
-                        y = foreground[i].y - SPRITE_SIZE * (is_big() ? 4 : 2);
-                        if (shakeOnLanding) {
-                            shaker.set_shake(shakeOnLanding);
-                            shakeOnLanding = 0;
-                            audioHandler.play(4);
-                        }
-                    }
-                    else if (yVel < 0) {
-                        // Collided from bottom
-                        y = foreground[i].y + SPRITE_SIZE;
-                    }
-                    yVel = 0;
+void reset_bosses() {
+    for (uint8_t i = 0; i < bosses.size(); i++) {
+        bosses[i].reset();
+    }
+}
+
+// Largest body in the broadphase (big boss), used to work out where to start searching
+const uint8_t BROADPHASE_MAX_BODY_SIZE = SPRITE_SIZE * 4;
+
+enum class BodyType {
+    ENEMY,
+    BOSS,
+    PROJECTILE
+};
+
+struct BroadphaseBody {
+    BodyType type;
+    EntityHandle handle; // for bosses, slot is the index into bosses
+    float minX, maxX, minY, maxY;
+};
+
+// Sort-and-sweep broadphase for enemies, bosses and projectiles.
+// Bodies are kept sorted by their left edge. Since things only move a little each frame, the order from the previous frame is kept
+// and re-sorted with an insertion sort, which is close to linear when the order is almost right.
+// query() then only has to look at the bodies in a small x range, instead of everything in the level.
+class Broadphase {
+public:
+    // Results of the last query (current indices into enemies, bosses and projectiles)
+    std::vector<uint16_t> nearbyEnemies;
+    std::vector<uint16_t> nearbyBosses;
+    std::vector<uint16_t> nearbyProjectiles;
+
+    void clear() {
+        bodies.clear();
+        nearbyEnemies.clear();
+        nearbyBosses.clear();
+        nearbyProjectiles.clear();
+    }
+
+    // Call after anything has moved/spawned/been removed
+    void update() {
+        enemiesAdded.assign(enemies.size(), false);
+        projectilesAdded.assign(projectiles.size(), false);
+
+        // Refresh bodies from last frame, keeping their order, and drop any which have gone
+        uint16_t count = 0;
+        for (uint16_t i = 0; i < bodies.size(); i++) {
+            BroadphaseBody body = bodies[i];
+
+            if (body.type == BodyType::ENEMY) {
+                uint16_t index = enemies.index_of(body.handle);
+                if (index == ENTITY_INDEX_NONE || !enemies.health[index]) {
+                    continue;
                 }
+                enemiesAdded[index] = true;
+                set_enemy_bounds(body, index);
             }
-
-            // Platforms may need work
-            if (!is_big()) {
-                for (uint16_t i = 0; i < platforms.size(); i++) {
-                    if (colliding(platforms[i])) {
-                        if (yVel > 0 && y + SPRITE_SIZE * 2 < platforms[i].y + SPRITE_QUARTER) {
-                            // Collided from top
-                            y = platforms[i].y - SPRITE_SIZE * 2;
-                            if (shakeOnLanding) {
-                                shaker.set_shake(shakeOnLanding);
-                                shakeOnLanding = 0;
-                                audioHandler.play(4);
-                            }
-                            yVel = 0;
-                        }
-                    }
+            else if (body.type == BodyType::PROJECTILE) {
+                uint16_t index = projectiles.index_of(body.handle);
+                if (index == ENTITY_INDEX_NONE) {
+                    continue;
                 }
+                projectilesAdded[index] = true;
+                set_projectile_bounds(body, index);
+            }
+            else {
+                // Bosses are added again below (there's never more than a couple)
+                continue;
             }
 
-            // Move entity x
-            x += xVel * dt;
+            bodies[count++] = body;
+        }
+        bodies.resize(count);
 
-            // Here check collisions...
-            for (uint16_t i = 0; i < foreground.size(); i++) {
-                if (colliding(foreground[i])) {
-                    if (xVel > 0) {
-                        // Collided from left
-                        x = foreground[i].x - SPRITE_SIZE * (is_big() ? 4 : 2) + 1;
-                    }
-                    else if (xVel < 0) {
-                        // Collided from right
-                        x = foreground[i].x + SPRITE_SIZE - 1;
-                    }
-                    xVel = 0;
-                }
+        // Add anything new
+        for (uint16_t i = 0; i < enemies.size(); i++) {
+            if (!enemiesAdded[i] && enemies.health[i]) {
+                BroadphaseBody body;
+                body.type = BodyType::ENEMY;
+                body.handle = enemies.handle_of(i);
+                set_enemy_bounds(body, i);
+                bodies.push_back(body);
             }
+        }
 
-            if (xVel > 0) {
-                lastDirection = 1;
-            }
-            else if (xVel < 0) {
-                lastDirection = 0;
+        for (uint16_t i = 0; i < projectiles.size(); i++) {
+            if (!projectilesAdded[i]) {
+                BroadphaseBody body;
+                body.type = BodyType::PROJECTILE;
+                body.handle = projectiles.handle_of(i);
+                set_projectile_bounds(body, i);
+                bodies.push_back(body);
             }
         }
+
+        add_bosses();
+
+        sort();
     }
 
-    void render(Camera camera) {
-        if (!dead) {
-            if (is_big()) {
-                uint16_t frame = anchorFrame;
+    // Boss bodies hold indices into bosses, so call this after removing any bosses
+    void update_bosses() {
+        bodies.erase(std::remove_if(bodies.begin(), bodies.end(), [](const BroadphaseBody& body) { return body.type == BodyType::BOSS; }), bodies.end());
 
-                //if (true) { //state != 0 //health < 3
-                //    frame = anchorFrame + 8 + 16 * 4;
-                //}
+        add_bosses();
 
-                if (yVel < -50) {
-                    frame = anchorFrame + 4;
-                }
-                else if (yVel > 160) {
-                    frame = anchorFrame + 8;
-                }
+        sort();
+    }
 
-                if (injuredTimer) {
-                    frame = anchorFrame + 12;
-                }
+    // Finds all bodies overlapping the box, and puts them in nearbyEnemies/nearbyBosses/nearbyProjectiles.
+    // The bounds are only as up to date as the last update(), so callers still need to do their own exact check.
+    void query(float minX, float minY, float maxX, float maxY) {
+        nearbyEnemies.clear();
+        nearbyBosses.clear();
+        nearbyProjectiles.clear();
 
-                if (lastDirection == 1) {
-                    for (uint8_t i = 0; i < 4; i++) {
-                        for (uint8_t j = 0; j < 4; j++) {
-                            render_sprite(frame + i + j * 16, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE * (3 - i), SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE * j), SpriteTransform::HORIZONTAL);
-                        }
+        // Nothing starting further left than this can reach the box
+        std::vector<BroadphaseBody>::iterator it = std::lower_bound(bodies.begin(), bodies.end(), minX - BROADPHASE_MAX_BODY_SIZE, [](const BroadphaseBody& body, float value) { return body.minX < value; });
+
+        for (; it != bodies.end() && it->minX < maxX; it++) {
+            if (it->maxX > minX && it->maxY > minY && it->minY < maxY) {
+                if (it->type == BodyType::ENEMY) {
+                    uint16_t index = enemies.index_of(it->handle);
+                    if (index != ENTITY_INDEX_NONE) {
+                        nearbyEnemies.push_back(index);
                     }
                 }
-                else {
-                    for (uint8_t i = 0; i < 4; i++) {
-                        for (uint8_t j = 0; j < 4; j++) {
-                            render_sprite(frame + i + j * 16, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE * i, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE * j));
-                        }
+                else if (it->type == BodyType::PROJECTILE) {
+                    uint16_t index = projectiles.index_of(it->handle);
+                    if (index != ENTITY_INDEX_NONE) {
+                        nearbyProjectiles.push_back(index);
                     }
                 }
-            }
-            else {
-                uint16_t frame = anchorFrame;
-
-                if (yVel < -50) {
-                    frame = anchorFrame + 2;
-                }
-                else if (yVel > 160) {
-                    frame = anchorFrame + 4;
-                }
-
-                if (injuredTimer) {
-                    frame = anchorFrame + 6;
-                }
-
-                if (lastDirection == 1) {
-                    //screen.sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y), SpriteTransform::HORIZONTAL);
-                    render_sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE, SCREEN_MID_HEIGHT + y - camera.y), SpriteTransform::HORIZONTAL);
-                    render_sprite(frame + 1, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y), SpriteTransform::HORIZONTAL);
-                    render_sprite(frame + 16, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE), SpriteTransform::HORIZONTAL);
-                    render_sprite(frame + 17, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE), SpriteTransform::HORIZONTAL);
-                }
-                else {
-                    //screen.sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
-                    render_sprite(frame, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y));
-                    render_sprite(frame + 1, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE, SCREEN_MID_HEIGHT + y - camera.y));
-                    render_sprite(frame + 16, Point(SCREEN_MID_WIDTH + x - camera.x, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE));
-                    render_sprite(frame + 17, Point(SCREEN_MID_WIDTH + x - camera.x + SPRITE_SIZE, SCREEN_MID_HEIGHT + y - camera.y + SPRITE_SIZE));
+                else if (it->handle.slot < bosses.size()) {
+                    nearbyBosses.push_back(it->handle.slot);
                 }
             }
         }
-
-        // Particles
-        for (uint8_t i = 0; i < particles.size(); i++) {
-            particles[i].render(camera);
-        }
     }
 
-    bool colliding(Tile tile) {
-        if (is_big()) {
-            return (tile.x + SPRITE_SIZE > x + 1 && tile.x < x + SPRITE_SIZE * 4 - 1 && tile.y + SPRITE_SIZE > y && tile.y < y + SPRITE_SIZE * 4);
-        }
-        else {
-            return (tile.x + SPRITE_SIZE > x + 1 && tile.x < x + SPRITE_SIZE * 2 - 1 && tile.y + SPRITE_SIZE > y && tile.y < y + SPRITE_SIZE * 2);
+protected:
+    void add_bosses() {
+        for (uint16_t i = 0; i < bosses.size(); i++) {
+            BroadphaseBody body;
+            body.type = BodyType::BOSS;
+            body.handle = EntityHandle{ i, 0 };
+            body.minX = bosses[i].x;
+            body.maxX = bosses[i].x + bosses[i].get_size();
+            body.minY = bosses[i].y;
+            body.maxY = bosses[i].y + bosses[i].get_size();
+            bodies.push_back(body);
         }
     }
 
-    bool spawning_minions() {
-        return minionsToSpawn;
-    }
+    // Insertion sort by left edge
+    void sort() {
+        for (uint16_t i = 1; i < bodies.size(); i++) {
+            BroadphaseBody body = bodies[i];
 
-    bool is_dead() {
-        return dead;
+            uint16_t j = i;
+            while (j > 0 && bodies[j - 1].minX > body.minX) {
+                bodies[j] = bodies[j - 1];
+                j--;
+            }
+            bodies[j] = body;
+        }
     }
 
-    bool particles_left() {
-        return deathParticles;
+    void set_enemy_bounds(BroadphaseBody& body, uint16_t index) {
+        body.minX = enemies.x[index];
+        body.maxX = enemies.x[index] + SPRITE_SIZE;
+        body.minY = enemies.y[index];
+        body.maxY = enemies.y[index] + SPRITE_SIZE;
     }
 
-    void reset() {
-        dead = false;
-        particles.clear();
-        shakeOnLanding = false;
-        x = spawnX;
-        y = spawnY;
-        injuredTimer = 0;
-        minionsToSpawn = 0;
-        state = 0;
-        health = bossHealths[(uint8_t)enemyType];
+    void set_projectile_bounds(BroadphaseBody& body, uint16_t index) {
+        uint8_t width = projectiles.cold[index].width;
+        body.minX = projectiles.x[index] + SPRITE_HALF - width / 2;
+        body.maxX = projectiles.x[index] + SPRITE_HALF + width / 2;
+        body.minY = projectiles.y[index] + SPRITE_HALF - width / 2;
+        body.maxY = projectiles.y[index] + SPRITE_HALF + width / 2;
     }
 
-protected:
-    float injuredTimer;
-    uint8_t minionsToSpawn;
+    std::vector<BroadphaseBody> bodies;
 
-    uint16_t spawnX, spawnY;
-    bool dead;
-    float shakeOnLanding;
+    std::vector<bool> enemiesAdded;
+    std::vector<bool> projectilesAdded;
 };
-std::vector<Boss> bosses; // used for levels where there is a boss.
-
-void reset_bosses() {
-    for (uint8_t i = 0; i < bosses.size(); i++) {
-        bosses[i].reset();
-    }
-}
+Broadphase broadphase;
 
 class Player : public Entity {
 public:
@@ -3401,18 +4682,21 @@ public:
             if (coinCount != coins.size()) {
                 // Must have picked up a coin
                 // Play coin sfx
-                audioHandler.play(coinSfxAlternator ? 0 : 2);
-                coinSfxAlternator = !coinSfxAlternator;
+                audioHandler.play(2);
             }
 
 
-            uint8_t enemyCount = enemies.size();// + bosses.size();
-
             // Remove enemies if no health left
-            enemies.erase(std::remove_if(enemies.begin(), enemies.end(), [](Enemy enemy) { return (enemy.health == 0 && enemy.particles.size() == 0); }), enemies.end());
-            bosses.erase(std::remove_if(bosses.begin(), bosses.end(), [](Boss boss) { return (boss.is_dead() && !boss.particles_left()); }), bosses.end());
+            uint16_t enemiesRemoved = enemies.remove_if([](uint16_t i) { return (enemies.health[i] == 0 && enemies.cold[i].particles.size() == 0); });
+            uint8_t bossCount = bosses.size();
+            bosses.erase(std::remove_if(bosses.begin(), bosses.end(), [](const Boss& boss) { return (boss.is_dead() && !boss.particles_left()); }), bosses.end());
+
+            if (bosses.size() != bossCount) {
+                // Boss indices have changed
+                broadphase.update_bosses();
+            }
 
-            enemiesKilled += enemyCount - enemies.size();// - bosses.size();
+            enemiesKilled += enemiesRemoved;
 
             update_collisions();
 
@@ -3451,7 +4735,7 @@ public:
         }
 
         for (uint16_t i = 0; i < slowParticles.size(); i++) {
-            slowParticles[i].update(dt);
+            slowParticles[i].update(dt, camera);
         }
         // Remove any particles which are too old
         slowParticles.erase(std::remove_if(slowParticles.begin(), slowParticles.end(), [](BrownianParticle particle) { return (particle.age >= PLAYER_SLOW_PARTICLE_AGE); }), slowParticles.end());
@@ -3503,7 +4787,7 @@ public:
                 }
                 else {
                     for (uint8_t i = 0; i < particles.size(); i++) {
-                        particles[i].update(dt);
+                        particles[i].update(dt, camera);
                     }
 
                     // Remove any particles which are too old
@@ -3534,29 +4818,33 @@ public:
 
             // Here check collisions...
 
+            // Only check things the broadphase says are nearby
+            broadphase.query(x, y, x + SPRITE_SIZE, y + SPRITE_SIZE);
+
             // Enemies first
-            for (uint16_t i = 0; i < enemies.size(); i++) {
-                if (enemies[i].health && colliding(enemies[i])) {
-                    if (y + SPRITE_SIZE < enemies[i].y + SPRITE_QUARTER) {
+            for (uint16_t n = 0; n < broadphase.nearbyEnemies.size(); n++) {
+                uint16_t i = broadphase.nearbyEnemies[n];
+                if (enemies.health[i] && colliding_enemy(i)) {
+                    if (y + SPRITE_SIZE < enemies.y[i] + SPRITE_QUARTER) {
                         // Collided from top
-                        y = enemies[i].y - SPRITE_SIZE;
+                        y = enemies.y[i] - SPRITE_SIZE;
 
-                        if (yVel > 0 || enemies[i].yVel < 0) { // && !enemies[i].is_immune()
+                        if (yVel > 0 || enemies.yVel[i] < 0) { // && !enemies[i].is_immune()
                             //yVel = -PLAYER_ATTACK_JUMP;
                             yVel = -std::max(yVel * PLAYER_ATTACK_JUMP_SCALE, PLAYER_ATTACK_JUMP_MIN);
 
                             // Take health off enemy
-                            enemies[i].health--;
+                            enemies.health[i]--;
 
                             // Play enemy injured sfx
-                            if (enemies[i].health) {
+                            if (enemies.health[i]) {
                                 audioHandler.play(4);
                             }
 
-                            if (enemies[i].yVel < 0) {
+                            if (enemies.yVel[i] < 0) {
                                 // Enemy is jumping
                                 // Stop enemy's jump
-                                enemies[i].yVel = 0;
+                                enemies.yVel[i] = 0;
                             }
                         }
                     }
@@ -3564,7 +4852,8 @@ public:
             }
 
             if (!dropPlayer) {
-                for (uint16_t i = 0; i < bosses.size(); i++) {
+                for (uint16_t n = 0; n < broadphase.nearbyBosses.size(); n++) {
+                    uint16_t i = broadphase.nearbyBosses[n];
                     if (!bosses[i].is_dead() && colliding(bosses[i])) {
                         if (y + SPRITE_SIZE < bosses[i].y + SPRITE_QUARTER) {
                             // Collided from top
@@ -3691,14 +4980,18 @@ public:
             //}
 
             if (!immuneTimer && !dropPlayer) {
-                for (uint16_t i = 0; i < enemies.size(); i++) {
-                    if (colliding(enemies[i]) && enemies[i].health) {
+                broadphase.query(x, y, x + SPRITE_SIZE, y + SPRITE_SIZE);
+
+                for (uint16_t n = 0; n < broadphase.nearbyEnemies.size(); n++) {
+                    uint16_t i = broadphase.nearbyEnemies[n];
+                    if (colliding_enemy(i) && enemies.health[i]) {
                         health--;
                         set_immune();
                     }
                 }
 
-                for (uint16_t i = 0; i < bosses.size(); i++) {
+                for (uint16_t n = 0; n < broadphase.nearbyBosses.size(); n++) {
+                    uint16_t i = broadphase.nearbyBosses[n];
                     if (colliding(bosses[i]) && bosses[i].health) {
                         health--;
                         set_immune();
@@ -3784,12 +5077,12 @@ public:
         return (tile.x + SPRITE_SIZE > x + 1 && tile.x < x + SPRITE_SIZE - 1 && tile.y + SPRITE_SIZE > y && tile.y < y + SPRITE_SIZE);
     }
 
-    bool colliding(Enemy enemy) {
+    bool colliding_enemy(uint16_t i) {
         // Replace use of this with actual code?
-        return (enemy.x + SPRITE_SIZE > x && enemy.x < x + SPRITE_SIZE && enemy.y + SPRITE_SIZE > y && enemy.y < y + SPRITE_SIZE);
+        return (enemies.x[i] + SPRITE_SIZE > x && enemies.x[i] < x + SPRITE_SIZE && enemies.y[i] + SPRITE_SIZE > y && enemies.y[i] < y + SPRITE_SIZE);
     }
 
-    bool colliding(Boss boss) {
+    bool colliding(Boss& boss) {
         if (boss.is_big()) {
             return (boss.x + SPRITE_SIZE * 4 > x && boss.x < x + SPRITE_SIZE && boss.y + SPRITE_SIZE * 4 > y && boss.y < y + SPRITE_SIZE);
         }
@@ -3824,14 +5117,133 @@ protected:
 Player player;
 
 
+// Lookup tables for blending a colour over the framebuffer, one per channel: lut[destination] = result
+class TintTable {
+public:
+    TintTable() {
+        colour = Colour(0, 0, 0, 0);
+        build();
+    }
+
+    void set(Colour tint) {
+        if (tint.r != colour.r || tint.g != colour.g || tint.b != colour.b || tint.a != colour.a) {
+            colour = tint;
+            build();
+        }
+    }
+
+    uint8_t r[256], g[256], b[256];
+
+protected:
+    void build() {
+        for (uint16_t i = 0; i < 256; i++) {
+            r[i] = (colour.r * colour.a + i * (255 - colour.a)) / 255;
+            g[i] = (colour.g * colour.a + i * (255 - colour.a)) / 255;
+            b[i] = (colour.b * colour.a + i * (255 - colour.a)) / 255;
+        }
+    }
+
+    Colour colour;
+};
+TintTable tintTable;
+
+// Blends colour over rect, as if a rectangle with the given alpha was drawn passes times, but in a single pass over the framebuffer
+void tint_rect(Rect rect, Colour colour, uint8_t alpha, uint8_t passes) {
+    // Repeated blends with alpha a leave (1 - a)^n of the destination
+    float remaining = std::pow(1.0f - alpha / 255.0f, passes);
+    colour.a = 255 - (uint8_t)(remaining * 255.0f + 0.5f);
+
+    if (screen.format != PixelFormat::RGB) {
+        // Fall back to the normal blend
+        screen.pen = Pen(colour.r, colour.g, colour.b, colour.a);
+        screen.rectangle(rect);
+        return;
+    }
+
+    rect = rect.intersection(screen.clip);
+
+    if (rect.empty() || !colour.a) {
+        return;
+    }
+
+    tintTable.set(colour);
+
+    for (int32_t y = rect.y; y < rect.y + rect.h; y++) {
+        uint8_t* pixel = screen.data + y * screen.row_stride + rect.x * 3;
+
+        for (int32_t x = 0; x < rect.w; x++) {
+            pixel[0] = tintTable.r[pixel[0]];
+            pixel[1] = tintTable.g[pixel[1]];
+            pixel[2] = tintTable.b[pixel[2]];
+            pixel += 3;
+        }
+    }
+}
+
+void tint_rect(Rect rect, Colour colour) {
+    tint_rect(rect, colour, colour.a, 1);
+}
+
 void background_rect(uint8_t position) {
     if (position) {
-        screen.pen = Pen(hudBackground.r, hudBackground.g, hudBackground.b, hudBackground.a);
-        screen.rectangle(Rect(0, SCREEN_HEIGHT - (SPRITE_SIZE + 12), SCREEN_WIDTH, SPRITE_SIZE + 12));
+        tint_rect(Rect(0, SCREEN_HEIGHT - (SPRITE_SIZE + 12), SCREEN_WIDTH, SPRITE_SIZE + 12), hudBackground);
     }
     else {
-        screen.pen = Pen(hudBackground.r, hudBackground.g, hudBackground.b, hudBackground.a);
-        screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SPRITE_SIZE + 12));
+        tint_rect(Rect(0, 0, SCREEN_WIDTH, SPRITE_SIZE + 12), hudBackground);
+    }
+}
+
+// Badge tiers and text for a set of level results, worked out once instead of every frame
+struct LevelStats {
+    // 0 is gold, 1 is silver, 2 is bronze
+    uint8_t scoreBadge;
+    uint8_t enemiesKilledBadge;
+    uint8_t timeBadge;
+
+    std::string scoreString;
+    std::string enemiesKilledString;
+    std::string timeString;
+};
+
+// Best results for each player and level, updated when the save data changes
+LevelStats levelStatsCache[2][LEVEL_COUNT];
+
+// Results of the level being played, for display_stats
+LevelStats currentStats;
+uint8_t currentStatsLevel = NO_LEVEL_SELECTED;
+uint8_t currentStatsScore, currentStatsEnemiesKilled;
+float currentStatsTime;
+
+std::string format_time(float time) {
+    // Trim to 2dp
+    std::string timeString = std::to_string(time);
+    return timeString.substr(0, timeString.find('.') + 3);
+}
+
+LevelStats calculate_level_stats(uint8_t levelNumber, uint8_t score, uint8_t enemiesKilled, float time) {
+    LevelStats stats;
+
+    stats.scoreBadge = score >= levelTargets[levelNumber][0][0] ? 0 : score >= levelTargets[levelNumber][0][1] ? 1 : 2;
+    stats.enemiesKilledBadge = enemiesKilled >= levelTargets[levelNumber][1][0] ? 0 : enemiesKilled >= levelTargets[levelNumber][1][1] ? 1 : 2;
+    stats.timeBadge = time <= levelTargetTimes[levelNumber][0] ? 0 : time <= levelTargetTimes[levelNumber][1] ? 1 : 2;
+
+    stats.scoreString = std::to_string(score);
+    stats.enemiesKilledString = std::to_string(enemiesKilled);
+    stats.timeString = format_time(time);
+
+    return stats;
+}
+
+void update_level_stats(uint8_t playerID, uint8_t levelNumber) {
+    LevelSaveData& levelSaveData = allLevelSaveData[playerID][levelNumber];
+    levelStatsCache[playerID][levelNumber] = calculate_level_stats(levelNumber, levelSaveData.score, levelSaveData.enemiesKilled, levelSaveData.time);
+}
+
+void update_all_level_stats() {
+    for (uint8_t i = 0; i < 2; i++) {
+        for (uint8_t j = 0; j < LEVEL_COUNT; j++) {
+            update_level_stats(i, j);
+        }
     }
 }
 
@@ -3841,20 +5253,27 @@ void display_stats(bool showBadges) {
     screen.text("Time taken:", minimal_font, Point(SPRITE_SIZE, SCREEN_MID_HEIGHT + SPRITE_SIZE * 2), true, TextAlign::center_left);
 
 
-    screen.text(std::to_string(player.score), minimal_font, Point(SCREEN_WIDTH - SPRITE_SIZE * 2, SCREEN_MID_HEIGHT - SPRITE_SIZE * 2), true, TextAlign::center_right);
-    screen.text(std::to_string(player.enemiesKilled), minimal_font, Point(SCREEN_WIDTH - SPRITE_SIZE * 2, SCREEN_MID_HEIGHT), true, TextAlign::center_right);
+    // Results don't change while this is shown (paused, lost or won), so only recalculate when they do
+    if (currentStatsLevel != currentLevelNumber || currentStatsScore != player.score || currentStatsEnemiesKilled != player.enemiesKilled || currentStatsTime != player.levelTimer) {
+        currentStats = calculate_level_stats(currentLevelNumber, player.score, player.enemiesKilled, player.levelTimer);
+
+        currentStatsLevel = currentLevelNumber;
+        currentStatsScore = player.score;
+        currentStatsEnemiesKilled = player.enemiesKilled;
+        currentStatsTime = player.levelTimer;
+    }
+
+    screen.text(currentStats.scoreString, minimal_font, Point(SCREEN_WIDTH - SPRITE_SIZE * 2, SCREEN_MID_HEIGHT - SPRITE_SIZE * 2), true, TextAlign::center_right);
+    screen.text(currentStats.enemiesKilledString, minimal_font, Point(SCREEN_WIDTH - SPRITE_SIZE * 2, SCREEN_MID_HEIGHT), true, TextAlign::center_right);
     //screen.text(std::to_string((int)player.levelTimer), minimal_font, Point(SCREEN_WIDTH - SPRITE_SIZE * 2, SCREEN_MID_HEIGHT + SPRITE_SIZE * 2), true, TextAlign::center_right);
 
-    // Trim player.levelTimer to 2dp
-    std::string levelTimerString = std::to_string(player.levelTimer);
-    levelTimerString = levelTimerString.substr(0, levelTimerString.find('.') + 3);
-    screen.text(levelTimerString, minimal_font, Point(SCREEN_WIDTH - SPRITE_SIZE * 2, SCREEN_MID_HEIGHT + SPRITE_SIZE * 2), true, TextAlign::center_right);
+    screen.text(currentStats.timeString, minimal_font, Point(SCREEN_WIDTH - SPRITE_SIZE * 2, SCREEN_MID_HEIGHT + SPRITE_SIZE * 2), true, TextAlign::center_right);
 
 
     uint8_t i, j, k;
-    i = player.score >= levelTargets[currentLevelNumber][0][0] ? 0 : player.score >= levelTargets[currentLevelNumber][0][1] ? 1 : 2;
-    j = player.enemiesKilled >= levelTargets[currentLevelNumber][1][0] ? 0 : player.enemiesKilled >= levelTargets[currentLevelNumber][1][1] ? 1 : 2;
-    k = player.levelTimer <= levelTargetTimes[currentLevelNumber][0] ? 0 : player.levelTimer <= levelTargetTimes[currentLevelNumber][1] ? 1 : 2;
+    i = currentStats.scoreBadge;
+    j = currentStats.enemiesKilledBadge;
+    k = currentStats.timeBadge;
 
     /*screen.text("Rank:", minimal_font, Point(SPRITE_SIZE, SPRITE_HALF * 7), true, TextAlign::center_left);
     render_sprite(TILE_ID_GOLD_BADGE + i, Point(SCREEN_MID_WIDTH - SPRITE_HALF, SPRITE_SIZE * 3));*/
@@ -3875,27 +5294,19 @@ void display_stats(bool showBadges) {
 
 
 void open_transition() {
-    for (uint16_t i = 0; i < SCREEN_TILE_SIZE; i++) {
-        transition[i].open();
-    }
+    transition.open();
 }
 
 void close_transition() {
-    for (uint16_t i = 0; i < SCREEN_TILE_SIZE; i++) {
-        transition[i].close();
-    }
+    transition.close();
 }
 
 void render_transition() {
-    for (uint16_t i = 0; i < SCREEN_TILE_SIZE; i++) {
-        transition[i].render(camera);
-    }
+    transition.render();
 }
 
 void update_transition(float dt, ButtonStates buttonStates) {
-    for (uint16_t i = 0; i < SCREEN_TILE_SIZE; i++) {
-        transition[i].update(dt, buttonStates);
-    }
+    transition.update(dt);
 }
 
 
@@ -3905,8 +5316,20 @@ void render_tiles(std::vector<Tile> tiles) {
     }
 }
 
-void render_parallax(std::vector<ParallaxTile> parallax) {
-    screen.alpha = 192;
+void render_parallax(std::vector<ParallaxTile>& parallax) {
+    if (!quality.get_parallax_alpha()) {
+        // Skipped at lowest quality
+        return;
+    }
+
+#ifdef PREBLEND_PARALLAX
+    // Back layer first
+    if (parallaxStrips[1].render(camera, quality.get_parallax_alpha()) && parallaxStrips[0].render(camera, quality.get_parallax_alpha())) {
+        return;
+    }
+#endif // PREBLEND_PARALLAX
+
+    screen.alpha = quality.get_parallax_alpha();
     for (uint32_t i = 0; i < parallax.size(); i++) {
         parallax[i].render(camera);
     }
@@ -3917,40 +5340,116 @@ void render_coins() {
     for (uint8_t i = 0; i < coins.size(); i++) {
         coins[i].render(camera);
     }
-}
+}
+
+void render_enemies() {
+    for (uint16_t i = 0; i < enemies.size(); i++) {
+        Enemy(enemies, i).render(camera);
+    }
+}
+
+void render_bosses() {
+    for (uint8_t i = 0; i < bosses.size(); i++) {
+        bosses[i].render(camera);
+    }
+}
+
+void render_level_triggers() {
+    for (uint8_t i = 0; i < levelTriggers.size(); i++) {
+        levelTriggers[i].render(camera);
+    }
+}
+
+void render_projectiles() {
+    for (uint16_t i = 0; i < projectiles.size(); i++) {
+        render_sprite(projectiles.cold[i].id, Point(SCREEN_MID_WIDTH + projectiles.x[i] - camera.x, SCREEN_MID_HEIGHT + projectiles.y[i] - camera.y));
+    }
+}
+
+void render_image_particles() {
+    snowField.render(camera);
+}
+
+void render_finish() {
+    finish.render(camera);
+}
+
+// Sprites with no transparent pixels, indexed by sprite ID (filled in once the spritesheet is loaded)
+std::vector<bool> opaqueSprites;
+
+// If the background image is opaque and fills the screen, there's no need to clear the screen first
+bool backgroundCoversScreen = false;
+
+// Returns true if every pixel in rect is fully opaque
+bool is_surface_opaque(Surface* surface, Rect rect) {
+    if (surface->format == PixelFormat::RGB) {
+        return true;
+    }
+
+    for (int32_t y = rect.y; y < rect.y + rect.h; y++) {
+        for (int32_t x = rect.x; x < rect.x + rect.w; x++) {
+            uint32_t offset = surface->offset(x, y);
+
+            if (surface->format == PixelFormat::P) {
+                if (surface->palette[surface->data[offset]].a != 255) {
+                    return false;
+                }
+            }
+            else if (surface->format == PixelFormat::RGBA) {
+                if (surface->data[offset * 4 + 3] != 255) {
+                    return false;
+                }
+            }
+            else {
+                // Don't know, so assume it isn't
+                return false;
+            }
+        }
+    }
 
-void render_enemies() {
-    for (uint8_t i = 0; i < enemies.size(); i++) {
-        enemies[i].render(camera);
-    }
+    return true;
 }
 
-void render_bosses() {
-    for (uint8_t i = 0; i < bosses.size(); i++) {
-        bosses[i].render(camera);
-    }
-}
+void find_opaque_sprites() {
+    uint16_t columns = screen.sprites->bounds.w / SPRITE_SIZE;
+    uint16_t count = columns * (screen.sprites->bounds.h / SPRITE_SIZE);
 
-void render_level_triggers() {
-    for (uint8_t i = 0; i < levelTriggers.size(); i++) {
-        levelTriggers[i].render(camera);
+    opaqueSprites.assign(count, false);
+
+    for (uint16_t i = 0; i < count; i++) {
+        opaqueSprites[i] = is_surface_opaque(screen.sprites, Rect((i % columns) * SPRITE_SIZE, (i / columns) * SPRITE_SIZE, SPRITE_SIZE, SPRITE_SIZE));
     }
+
+    backgroundCoversScreen = background_image->bounds.w >= SCREEN_WIDTH && background_image->bounds.h >= SCREEN_HEIGHT && is_surface_opaque(background_image, Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
 }
 
-void render_projectiles() {
-    for (uint8_t i = 0; i < projectiles.size(); i++) {
-        projectiles[i].render(camera);
-    }
+bool is_sprite_opaque(uint16_t id) {
+    return id < opaqueSprites.size() && opaqueSprites[id];
 }
 
-void render_image_particles() {
-    for (uint16_t i = 0; i < imageParticles.size(); i++) {
-        imageParticles[i].render(camera);
+// Removes background tiles which are completely hidden behind opaque tiles drawn at full alpha (platforms can be drawn faded, so don't count)
+void remove_occluded_background(uint16_t levelWidth, uint16_t levelHeight) {
+    std::vector<bool> covered(levelWidth * levelHeight, false);
+
+    std::vector<Tile>* layers[] = { &generic_entities, &spikes, &foreground };
+    for (uint8_t i = 0; i < std::size(layers); i++) {
+        for (uint32_t j = 0; j < layers[i]->size(); j++) {
+            Tile& tile = (*layers[i])[j];
+            if (is_sprite_opaque(tile.get_id())) {
+                covered[(tile.y / SPRITE_SIZE) * levelWidth + tile.x / SPRITE_SIZE] = true;
+            }
+        }
     }
-}
 
-void render_finish() {
-    finish.render(camera);
+#ifdef PRINT_OCCLUSION_STATS
+    uint32_t tileCount = background.size();
+#endif // PRINT_OCCLUSION_STATS
+
+    background.erase(std::remove_if(background.begin(), background.end(), [&covered, levelWidth](const Tile& tile) { return covered[(tile.y / SPRITE_SIZE) * levelWidth + tile.x / SPRITE_SIZE]; }), background.end());
+
+#ifdef PRINT_OCCLUSION_STATS
+    printf("Removed %d of %d background tiles hidden by foreground\n", (int)(tileCount - background.size()), (int)tileCount);
+#endif // PRINT_OCCLUSION_STATS
 }
 
 void render_background() {
@@ -3990,100 +5489,164 @@ void render_particles() {
     render_image_particles();
 }
 
-void render_hud() {
-    screen.pen = Pen(hudBackground.r, hudBackground.g, hudBackground.b, hudBackground.a);
-    screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SPRITE_HALF * 2 + 2));
+// Off-screen RGBA layer holding a panel's text and sprites.
+// The panel is only redrawn when the key (a summary of the values shown on it) changes, otherwise the last drawing is blitted.
+class CachedPanel {
+public:
+    CachedPanel(uint16_t width, uint16_t height) : pixels(width * height * 4), surface(pixels.data(), PixelFormat::RGBA, Size(width, height)) {
+        valid = false;
+        key = 0;
+    }
 
+    // Returns true if the panel needs drawing into get_surface()
+    bool begin(uint32_t newKey) {
+        if (valid && key == newKey) {
+            return false;
+        }
 
-    screen.pen = Pen(defaultWhite.r, defaultWhite.g, defaultWhite.b);
+        key = newKey;
+        valid = true;
+
+        // Fully transparent
+        std::fill(pixels.begin(), pixels.end(), 0);
+
+        surface.sprites = screen.sprites;
+        surface.alpha = 255;
+
+        return true;
+    }
+
+    void invalidate() {
+        valid = false;
+    }
+
+    Surface& get_surface() {
+        return surface;
+    }
+
+    void render(Point point) {
+        screen.blit(&surface, Rect(0, 0, surface.bounds.w, surface.bounds.h), point);
+    }
+
+protected:
+    std::vector<uint8_t> pixels;
+    Surface surface;
+
+    bool valid;
+    uint32_t key;
+};
+
+const uint8_t HUD_PANEL_HEIGHT = SPRITE_SIZE + 2;
+const uint8_t LEVEL_INFO_PANEL_HEIGHT = SPRITE_SIZE + 12;
+const uint8_t LEVEL_INFO_PANEL_Y = SCREEN_HEIGHT - LEVEL_INFO_PANEL_HEIGHT;
+
+CachedPanel hudPanel(SCREEN_WIDTH, HUD_PANEL_HEIGHT);
+CachedPanel levelInfoPanel(SCREEN_WIDTH, LEVEL_INFO_PANEL_HEIGHT);
+
+void invalidate_panels() {
+    hudPanel.invalidate();
+    levelInfoPanel.invalidate();
+}
+
+void draw_hud_panel(Surface& surface) {
+    surface.pen = Pen(defaultWhite.r, defaultWhite.g, defaultWhite.b);
 
     // Player health
     for (uint8_t i = 0; i < PLAYER_MAX_HEALTH; i++) {
         if (i < player.health) {
-            render_sprite(TILE_ID_HEART, Point(2 + i * SPRITE_SIZE, 2));
-            //screen.sprite(TILE_ID_HEART, Point(2 + i * SPRITE_SIZE, 2));
+            surface.sprite(TILE_ID_HEART, Point(2 + i * SPRITE_SIZE, 2));
         }
         else {
-            render_sprite(TILE_ID_HEART + 1, Point(2 + i * SPRITE_SIZE, 2));
-            //screen.sprite(TILE_ID_HEART + 1, Point(2 + i * SPRITE_SIZE, 2));
+            surface.sprite(TILE_ID_HEART + 1, Point(2 + i * SPRITE_SIZE, 2));
         }
     }
 
     // Player score
-    blit::screen.text(std::to_string(player.score), minimal_font, Point(SCREEN_WIDTH - SPRITE_SIZE - 2, 2), true, blit::TextAlign::top_right);
+    surface.text(std::to_string(player.score), minimal_font, Point(SCREEN_WIDTH - SPRITE_SIZE - 2, 2), true, blit::TextAlign::top_right);
 
-    render_sprite(TILE_ID_HUD_COINS, Point(SCREEN_WIDTH - SPRITE_SIZE, 2));
-    //screen.sprite(TILE_ID_HUD_COINS, Point(SCREEN_WIDTH - SPRITE_SIZE, 2));
+    surface.sprite(TILE_ID_HUD_COINS, Point(SCREEN_WIDTH - SPRITE_SIZE, 2));
 
 
     // Player lives
-    blit::screen.text(std::to_string(player.lives), minimal_font, Point(2 + 6 * SPRITE_SIZE - 2, 2), true, blit::TextAlign::top_right);
+    surface.text(std::to_string(player.lives), minimal_font, Point(2 + 6 * SPRITE_SIZE - 2, 2), true, blit::TextAlign::top_right);
 
-    render_sprite(TILE_ID_HUD_LIVES + playerSelected, Point(2 + 6 * SPRITE_SIZE, 2));
-    //screen.sprite(TILE_ID_HUD_LIVES + playerSelected, Point(2 + 6 * SPRITE_SIZE, 2));
+    surface.sprite(TILE_ID_HUD_LIVES + playerSelected, Point(2 + 6 * SPRITE_SIZE, 2));
 }
 
-void render_nearby_level_info() {
-    for (uint8_t i = 0; i < levelTriggers.size(); i++) {
-        if (std::abs(player.x - levelTriggers[i].x) < LEVEL_INFO_MAX_RANGE && std::abs(player.y - levelTriggers[i].y) < LEVEL_INFO_MAX_RANGE) {
-            background_rect(1);
+void render_hud() {
+    tint_rect(Rect(0, 0, SCREEN_WIDTH, HUD_PANEL_HEIGHT), hudBackground);
 
+    // Only redraw the text and sprites if something shown has changed
+    uint32_t key = player.health | (player.lives << 8) | (playerSelected << 16) | (player.score << 17);
 
-            screen.pen = Pen(levelTriggerParticleColours[1].r, levelTriggerParticleColours[1].g, levelTriggerParticleColours[1].b);
+    if (hudPanel.begin(key)) {
+        draw_hud_panel(hudPanel.get_surface());
+    }
 
-            // Level number
-            screen.text("Level " + std::to_string(levelTriggers[i].levelNumber + 1), minimal_font, Point(SPRITE_HALF, SCREEN_HEIGHT - 9 - SPRITE_HALF), true, TextAlign::center_left);
+    hudPanel.render(Point(0, 0));
+}
 
+void draw_level_info_panel(Surface& surface, uint8_t levelNumber) {
+    // Positions are relative to the top of the panel
+    const uint8_t y = LEVEL_INFO_PANEL_Y;
 
-            screen.pen = Pen(defaultWhite.r, defaultWhite.g, defaultWhite.b);
+    surface.pen = Pen(levelTriggerParticleColours[1].r, levelTriggerParticleColours[1].g, levelTriggerParticleColours[1].b);
 
-            if (allPlayerSaveData[playerSelected].levelReached < levelTriggers[i].levelNumber) {
-                // Level is locked
-                screen.text("Level locked", minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF, SCREEN_HEIGHT - 9 + SPRITE_HALF), true, TextAlign::center_right);
-            }
-            else if (allPlayerSaveData[playerSelected].levelReached == levelTriggers[i].levelNumber) {
-                // Level is unlocked and has not been completed
-                screen.text("No highscores", minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF, SCREEN_HEIGHT - 9 + SPRITE_HALF), true, TextAlign::center_right);
-            }
-            else {
-                // Level is unlocked and has been completed
+    // Level number
+    surface.text("Level " + std::to_string(levelNumber + 1), minimal_font, Point(SPRITE_HALF, SCREEN_HEIGHT - 9 - SPRITE_HALF - y), true, TextAlign::center_left);
 
-                if (allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].time == 0.0f) {
-                    // If time == 0.0f, something's probably wrong (like no save slot for that level, but still save slot for saveData worked)
 
-                    screen.text("Error loading highscores", minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF, SCREEN_HEIGHT - 9 + SPRITE_HALF), true, TextAlign::center_right);
-                }
-                else {
-                    screen.text(std::to_string(allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].score), minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF * 25, SCREEN_HEIGHT - 9 + SPRITE_HALF), true, TextAlign::center_right);
-                    screen.text(std::to_string(allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].enemiesKilled), minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF * 16, SCREEN_HEIGHT - 9 + SPRITE_HALF), true, TextAlign::center_right);
-
-                    // Trim time to 2dp
-                    std::string timeString = std::to_string(allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].time);
-                    timeString = timeString.substr(0, timeString.find('.') + 3);
-                    screen.text(timeString, minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF * 4, SCREEN_HEIGHT - 9 + SPRITE_HALF), true, TextAlign::center_right);
-
-                    uint8_t a, b, c;
-                    a = allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].score >= levelTargets[levelTriggers[i].levelNumber][0][0] ? 0 : allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].score >= levelTargets[levelTriggers[i].levelNumber][0][1] ? 1 : 2;
-                    b = allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].enemiesKilled >= levelTargets[levelTriggers[i].levelNumber][1][0] ? 0 : allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].enemiesKilled >= levelTargets[levelTriggers[i].levelNumber][1][1] ? 1 : 2;
-                    c = allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].time <= levelTargetTimes[levelTriggers[i].levelNumber][0] ? 0 : allLevelSaveData[playerSelected][levelTriggers[i].levelNumber].time <= levelTargetTimes[levelTriggers[i].levelNumber][1] ? 1 : 2;
-
-                    render_sprite(TILE_ID_GOLD_BADGE + a + 24, Point(SCREEN_WIDTH - SPRITE_HALF * 24, SCREEN_HEIGHT - 9));
-                    render_sprite(TILE_ID_GOLD_BADGE + b + 28, Point(SCREEN_WIDTH - SPRITE_HALF * 15, SCREEN_HEIGHT - 9));
-                    render_sprite(TILE_ID_GOLD_BADGE + c + 32, Point(SCREEN_WIDTH - SPRITE_HALF * 3, SCREEN_HEIGHT - 9));
-
-                    /*render_sprite(TILE_ID_HUD_COINS, Point(SCREEN_WIDTH - SPRITE_HALF * 28, SCREEN_HEIGHT - 9));
-                    render_sprite(TILE_ID_HUD_ENEMIES_KILLED, Point(SCREEN_WIDTH - SPRITE_HALF * 18, SCREEN_HEIGHT - 9));
-                    render_sprite(TILE_ID_HUD_TIME_TAKEN, Point(SCREEN_WIDTH - SPRITE_HALF * 5, SCREEN_HEIGHT - 9));*/
-                }
+    surface.pen = Pen(defaultWhite.r, defaultWhite.g, defaultWhite.b);
+
+    if (allPlayerSaveData[playerSelected].levelReached < levelNumber) {
+        // Level is locked
+        surface.text("Level locked", minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF, SCREEN_HEIGHT - 9 + SPRITE_HALF - y), true, TextAlign::center_right);
+    }
+    else if (allPlayerSaveData[playerSelected].levelReached == levelNumber) {
+        // Level is unlocked and has not been completed
+        surface.text("No highscores", minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF, SCREEN_HEIGHT - 9 + SPRITE_HALF - y), true, TextAlign::center_right);
+    }
+    else {
+        // Level is unlocked and has been completed
+        LevelSaveData& levelSaveData = allLevelSaveData[playerSelected][levelNumber];
+        LevelStats& levelStats = levelStatsCache[playerSelected][levelNumber];
+
+        if (levelSaveData.time == 0.0f) {
+            // If time == 0.0f, something's probably wrong (like no save slot for that level, but still save slot for saveData worked)
+
+            surface.text("Error loading highscores", minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF, SCREEN_HEIGHT - 9 + SPRITE_HALF - y), true, TextAlign::center_right);
+        }
+        else {
+            surface.text(levelStats.scoreString, minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF * 25, SCREEN_HEIGHT - 9 + SPRITE_HALF - y), true, TextAlign::center_right);
+            surface.text(levelStats.enemiesKilledString, minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF * 16, SCREEN_HEIGHT - 9 + SPRITE_HALF - y), true, TextAlign::center_right);
+            surface.text(levelStats.timeString, minimal_font, Point(SCREEN_WIDTH - SPRITE_HALF * 4, SCREEN_HEIGHT - 9 + SPRITE_HALF - y), true, TextAlign::center_right);
+
+            surface.sprite(TILE_ID_GOLD_BADGE + levelStats.scoreBadge + 24, Point(SCREEN_WIDTH - SPRITE_HALF * 24, SCREEN_HEIGHT - 9 - y));
+            surface.sprite(TILE_ID_GOLD_BADGE + levelStats.enemiesKilledBadge + 28, Point(SCREEN_WIDTH - SPRITE_HALF * 15, SCREEN_HEIGHT - 9 - y));
+            surface.sprite(TILE_ID_GOLD_BADGE + levelStats.timeBadge + 32, Point(SCREEN_WIDTH - SPRITE_HALF * 3, SCREEN_HEIGHT - 9 - y));
+        }
+    }
+}
+
+void render_nearby_level_info() {
+    for (uint8_t i = 0; i < levelTriggers.size(); i++) {
+        if (std::abs(player.x - levelTriggers[i].x) < LEVEL_INFO_MAX_RANGE && std::abs(player.y - levelTriggers[i].y) < LEVEL_INFO_MAX_RANGE) {
+            background_rect(1);
+
+            // Save data only changes between levels (which invalidates the panel), so the trigger and player are enough to tell if it needs redrawing
+            uint32_t key = levelTriggers[i].levelNumber | (playerSelected << 8);
+
+            if (levelInfoPanel.begin(key)) {
+                draw_level_info_panel(levelInfoPanel.get_surface(), levelTriggers[i].levelNumber);
             }
 
-            //screen.text(std::to_string(saveData.scores[levelTriggers[i].levelNumber]), minimal_font, Point(SCREEN_MID_WIDTH, SCREEN_HEIGHT - 9), true, TextAlign::center_center);
+            levelInfoPanel.render(Point(0, LEVEL_INFO_PANEL_Y));
         }
     }
 }
 
 void load_level(uint8_t levelNumber) {
-    snowGenTimer = 0.0f;
+    invalidate_panels();
 
     // Variables for finding start and finish positions
     uint16_t finishX, finishY;
@@ -4117,7 +5680,7 @@ void load_level(uint8_t levelNumber) {
     bosses.clear();
     levelTriggers.clear();
     projectiles.clear();
-    imageParticles.clear();
+    snowField.clear();
     spikes.clear();
 
     // Foreground Layer
@@ -4175,32 +5738,32 @@ void load_level(uint8_t levelNumber) {
             levelTriggers.push_back(LevelTrigger((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 0));
         }
         else if (tmx->data[index] == TILE_ID_ENEMY_1) {
-            enemies.push_back(Enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, enemyHealths[0], 0));
+            spawn_enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 0);
         }
         else if (tmx->data[index] == TILE_ID_ENEMY_2) {
-            enemies.push_back(Enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, enemyHealths[1], 1));
+            spawn_enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 1);
         }
         else if (tmx->data[index] == TILE_ID_ENEMY_3) {
-            enemies.push_back(Enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, enemyHealths[2], 2));
+            spawn_enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 2);
         }
         else if (tmx->data[index] == TILE_ID_ENEMY_4) {
-            enemies.push_back(Enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, enemyHealths[3], 3));
+            spawn_enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 3);
         }
         else if (tmx->data[index] == TILE_ID_ENEMY_5) {
-            enemies.push_back(Enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, enemyHealths[4], 4));
+            spawn_enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 4);
         }
         else if (tmx->data[index] == TILE_ID_ENEMY_6) {
-            enemies.push_back(Enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, enemyHealths[5], 5));
+            spawn_enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 5);
         }
         else if (tmx->data[index] == TILE_ID_ENEMY_7) {
-            enemies.push_back(Enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, enemyHealths[6], 6));
+            spawn_enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 6);
         }
         else if (tmx->data[index] == TILE_ID_ENEMY_8) {
-            enemies.push_back(Enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, enemyHealths[7], 7));
+            spawn_enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 7);
         }
         else if (tmx->data[index] == TILE_ID_ENEMY_9) {
             // A ninth enemy!?
-            enemies.push_back(Enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, enemyHealths[8], 8));
+            spawn_enemy((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, 8);
         }
         else if (tmx->data[index] == TILE_ID_BOSS_1) {
             bosses.push_back(Boss((i % levelWidth) * SPRITE_SIZE, (i / levelWidth) * SPRITE_SIZE, bossHealths[0], 0));
@@ -4250,10 +5813,23 @@ void load_level(uint8_t levelNumber) {
         }
     }
 
+    // Background tiles behind opaque foreground would be drawn over straight away
+    remove_occluded_background(levelWidth, levelHeight);
+
+    // Build grid of solid tiles, used by the flow fields
+    tileGrid.build(levelWidth, levelHeight);
+    playerFlowField.clear();
+    spawnFlowFields.clear();
+
     // maybe adjust position of tile so that don't need to bunch all up in corner while designing level
 
     // go backwards through parallax layers so that rendering is correct
 
+#ifdef PREBLEND_PARALLAX
+    parallaxStrips[1].load(&tmx->data[levelSize * 5], levelWidth, levelHeight, parallaxFactorLayersX[1], parallaxFactorLayersY[1]);
+    parallaxStrips[0].load(&tmx->data[levelSize * 4], levelWidth, levelHeight, parallaxFactorLayersX[0], parallaxFactorLayersY[0]);
+#endif // PREBLEND_PARALLAX
+
     // Parallax Background Layer
     for (uint32_t i = 0; i < levelSize; i++) {
         uint32_t index = i + levelSize * 5;
@@ -4291,47 +5867,30 @@ void load_level(uint8_t levelNumber) {
     camera.y = cameraStartY;
 
     // Set player position pointers
-    for (uint8_t i = 0; i < enemies.size(); i++) {
-        enemies[i].set_player_position(&player.x, &player.y);
-    }
     for (uint8_t i = 0; i < bosses.size(); i++) {
         bosses[i].set_player_position(&player.x, &player.y);
     }
 
+    broadphase.clear();
+    broadphase.update();
 
     // Check there aren't any levelTriggers which have levelNumber >= LEVEL_COUNT
     levelTriggers.erase(std::remove_if(levelTriggers.begin(), levelTriggers.end(), [](LevelTrigger levelTrigger) { return levelTrigger.levelNumber >= LEVEL_COUNT; }), levelTriggers.end());
 
-    // Prep snow particles (create some so that it isn't empty to start with)
+    // Snow bounds only need working out once per level
     if (gameState == GameState::STATE_LEVEL_SELECT) {
-        for (uint16_t i = 0; i < SNOW_LEVEL_SELECT_INIT_COUNT; i++) {
-            // Generate snow particles
-            // Get random position
-            float xVel = rand() % 3 - 1;
-            float yVel = rand() % 5 + 8;
-            uint16_t startX = (levelTriggers[(SNOW_WORLD * LEVELS_PER_WORLD) - 1].x + levelTriggers[SNOW_WORLD * LEVELS_PER_WORLD].x) / 2;
-            //uint16_t endX = (levelTriggers[((SNOW_WORLD + 1) * LEVELS_PER_WORLD) - 1].x + levelTriggers[(SNOW_WORLD + 1) * LEVELS_PER_WORLD].x) / 2;
-            uint16_t endX = (levelTriggers[((SNOW_WORLD + 1) * LEVELS_PER_WORLD)].x + levelTriggers[((SNOW_WORLD + 1) * LEVELS_PER_WORLD) + 1].x) / 2;
-            float x = (rand() % (endX - startX)) + startX;
-            float y = (rand() % (levelData.levelHeight * SPRITE_SIZE + SCREEN_HEIGHT)) - SCREEN_MID_HEIGHT;
-            //if ((x > levelTriggers[SNOW_WORLD * LEVELS_PER_WORLD].x && x < levelTriggers[(SNOW_WORLD + 1) * LEVELS_PER_WORLD].x) || rand() % 2 == 0) {
-            if ((x > levelTriggers[SNOW_WORLD * LEVELS_PER_WORLD].x && x < levelTriggers[(SNOW_WORLD + 1) * LEVELS_PER_WORLD].x) || rand() % 2 == 0) {
-                // At edges, only make a half as many particles
-                imageParticles.push_back(ImageParticle(x, y, xVel, yVel, 0, 0, snowParticleImages[rand() % snowParticleImages.size()]));
-            }
-        }
+        // Only over the snow world, thinning out half way to the neighbouring worlds
+        float startX = (levelTriggers[(SNOW_WORLD * LEVELS_PER_WORLD) - 1].x + levelTriggers[SNOW_WORLD * LEVELS_PER_WORLD].x) / 2;
+        float endX = (levelTriggers[((SNOW_WORLD + 1) * LEVELS_PER_WORLD)].x + levelTriggers[((SNOW_WORLD + 1) * LEVELS_PER_WORLD) + 1].x) / 2;
+
+        snowField.init(SNOW_FIELD_LEVEL_SELECT_COUNT, startX, endX, levelTriggers[SNOW_WORLD * LEVELS_PER_WORLD].x, levelTriggers[(SNOW_WORLD + 1) * LEVELS_PER_WORLD].x, 3);
     }
     else if (currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8) {
-        // Generate snow particles
-        for (uint16_t i = 0; i < SNOW_LEVEL_INIT_COUNT; i++) {
-            // Get random position
-            // Change vel later (use wind?)
-            float xVel = rand() % 5 - 2;
-            float yVel = rand() % 5 + 8;
-            float x = (rand() % (levelData.levelWidth * SPRITE_SIZE + SCREEN_WIDTH)) - SCREEN_MID_WIDTH;
-            float y = (rand() % (levelData.levelHeight * SPRITE_SIZE + SCREEN_HEIGHT)) - SCREEN_MID_HEIGHT;
-            imageParticles.push_back(ImageParticle(x, y, xVel, yVel, 0, 0, snowParticleImages[rand() % snowParticleImages.size()]));
-        }
+        // Whole level
+        float startX = -SCREEN_MID_WIDTH;
+        float endX = levelData.levelWidth * SPRITE_SIZE + SCREEN_MID_WIDTH;
+
+        snowField.init(SNOW_FIELD_LEVEL_COUNT, startX, endX, startX, endX, 5);
     }
 }
 
@@ -4349,9 +5908,6 @@ void reset_level_vars() {
 void start_level(uint8_t levelNumber) {
     gameState = GameState::STATE_IN_GAME;
 
-    // Load coin sfx slot into select sfx slot
-    audioHandler.load(0, 2);
-
     // Load level
     load_level(levelNumber);
 
@@ -4413,6 +5969,9 @@ void start_level_select() {
 
     gameState = GameState::STATE_LEVEL_SELECT;
 
+    // Badges and text for the level info panel
+    update_all_level_stats();
+
     // Load level select level
     load_level(LEVEL_SELECT_NUMBER);
 
@@ -4489,6 +6048,9 @@ void start_game_won() {
     //save_game_data();
     save_player_data(playerSelected);
     save_level_data(playerSelected, currentLevelNumber);
+    save_now();
+
+    update_level_stats(playerSelected, currentLevelNumber);
 
     open_transition();
 }
@@ -4498,6 +6060,72 @@ void render_sg_icon() {
     screen.stretch_blit(sg_icon_image, Rect(0, 0, SG_ICON_SIZE, SG_ICON_SIZE), Rect(SCREEN_MID_WIDTH - SG_ICON_SIZE, SCREEN_MID_HEIGHT - SG_ICON_SIZE, SG_ICON_SIZE * 2, SG_ICON_SIZE * 2));
 }
 
+// Parts of the screen which need redrawing, for screens where most of the picture stays the same between frames.
+// Everything outside the dirty rects is left as it was drawn last frame.
+const uint8_t MAX_DIRTY_RECTS = 16;
+
+class DirtyRegions {
+public:
+    DirtyRegions() {
+        count = 0;
+        full = true;
+    }
+
+    void invalidate() {
+        full = true;
+    }
+
+    void add(Rect rect) {
+        if (full) {
+            return;
+        }
+
+        rect = rect.intersection(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
+
+        if (rect.empty()) {
+            return;
+        }
+
+        if (count == MAX_DIRTY_RECTS) {
+            // Too many to be worth it
+            full = true;
+            return;
+        }
+
+        rects[count++] = rect;
+    }
+
+    // Calls render_screen once for each dirty rect, clipped to that rect
+    void render(void (*render_screen)()) {
+        if (full) {
+            screen.clip = Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+            render_screen();
+        }
+        else {
+            for (uint8_t i = 0; i < count; i++) {
+                screen.clip = rects[i];
+                render_screen();
+            }
+
+            screen.clip = Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        }
+
+        count = 0;
+        full = false;
+    }
+
+protected:
+    Rect rects[MAX_DIRTY_RECTS];
+    uint8_t count;
+    bool full;
+};
+DirtyRegions dirtyRegions;
+
+// Summary of everything (other than animations) which affects how a static screen looks
+uint32_t staticScreenKey = 0;
+Point staticScreenCamera;
+bool staticScreenPrompt = false;
+
 void render_input_select() {
     render_background();
 
@@ -4542,8 +6170,7 @@ void render_character_select() {
     background_rect(0);
     background_rect(1);
 
-    screen.pen = Pen(hudBackground.r, hudBackground.g, hudBackground.b, hudBackground.a);
-    screen.rectangle(Rect(0, SCREEN_HEIGHT - (SPRITE_SIZE + 12 + 12), SCREEN_WIDTH, 12));
+    tint_rect(Rect(0, SCREEN_HEIGHT - (SPRITE_SIZE + 12 + 12), SCREEN_WIDTH, 12), hudBackground);
 
     screen.pen = Pen(levelTriggerParticleColours[1].r, levelTriggerParticleColours[1].g, levelTriggerParticleColours[1].b);
     screen.text("Player " + std::to_string(playerSelected + 1) + " (Save " + std::to_string(playerSelected + 1)  + ")", minimal_font, Point(SCREEN_MID_WIDTH, SCREEN_HEIGHT - 10 - 12), true, TextAlign::center_center);
@@ -4600,10 +6227,8 @@ void render_settings() {
     /*screen.pen = Pen(hudBackground.r, hudBackground.g, hudBackground.b, hudBackground.a);
     screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));*/
 
-    screen.pen = Pen(gameBackground.r, gameBackground.g, gameBackground.b, hudBackground.a); // use hudBackground.a to make background semi transparent
-    screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
-    screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
-    //screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT)); // repeat to make darker
+    // use hudBackground.a to make background semi transparent, twice as dark
+    tint_rect(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT), gameBackground, hudBackground.a, 2);
 
     background_rect(0);
 
@@ -4684,10 +6309,8 @@ void render_game() {
 
 
     if (gamePaused) {
-        screen.pen = Pen(gameBackground.r, gameBackground.g, gameBackground.b, hudBackground.a); // use hudBackground.a to make background semi transparent
-        screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
-        screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
-        screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT)); // repeat to make darker
+        // use hudBackground.a to make background semi transparent, three times as dark
+        tint_rect(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT), gameBackground, hudBackground.a, 3);
 
         //screen.pen = Pen(hudBackground.r, hudBackground.g, hudBackground.b, hudBackground.a);
         //screen.rectangle(Rect(0, SPRITE_SIZE + 12, SCREEN_WIDTH, SCREEN_HEIGHT - (SPRITE_SIZE + 12))); // do it twice to make it darker
@@ -4753,10 +6376,8 @@ void render_game_lost() {
 
     render_particles();
 
-    screen.pen = Pen(gameBackground.r, gameBackground.g, gameBackground.b, hudBackground.a); // use hudBackground.a to make background semi transparent
-    screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
-    screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
-    screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT)); // repeat to make darker
+    // use hudBackground.a to make background semi transparent, three times as dark
+    tint_rect(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT), gameBackground, hudBackground.a, 3);
 
     background_rect(0);
     background_rect(1);
@@ -4786,10 +6407,8 @@ void render_game_won() {
 
     render_particles();
 
-    screen.pen = Pen(gameBackground.r, gameBackground.g, gameBackground.b, hudBackground.a); // use hudBackground.a to make background semi transparent
-    screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
-    screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
-    screen.rectangle(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT)); // repeat to make darker
+    // use hudBackground.a to make background semi transparent, three times as dark
+    tint_rect(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT), gameBackground, hudBackground.a, 3);
 
     background_rect(0);
     background_rect(1);
@@ -4806,8 +6425,32 @@ void render_game_won() {
 }
 
 void update_enemies(float dt, ButtonStates buttonStates) {
-    for (int i = 0; i < enemies.size(); i++) {
-        enemies[i].update(dt, buttonStates);
+    for (uint8_t i = 0; i < ENEMY_BEHAVIOUR_COUNT; i++) {
+        enemyBatches[i].clear();
+    }
+
+    for (uint16_t i = 0; i < enemies.size(); i++) {
+        if (enemies.health[i]) {
+            enemyBatches[(uint8_t)enemies.cold[i].behaviour].push_back(i);
+        }
+    }
+
+    if (enemyBatches[(uint8_t)EnemyBehaviour::PURSUIT].size()) {
+        // Only recalculated when player moves into a different tile
+        playerFlowField.set_target(player.x + SPRITE_HALF, player.y + SPRITE_HALF);
+    }
+
+    update_enemy_batch<EnemyBehaviour::WALKING>(dt, player.x, player.y);
+    update_enemy_batch<EnemyBehaviour::RANGED>(dt, player.x, player.y);
+    update_enemy_batch<EnemyBehaviour::PURSUIT>(dt, player.x, player.y);
+    update_enemy_batch<EnemyBehaviour::FLYING>(dt, player.x, player.y);
+    update_enemy_batch<EnemyBehaviour::SHOOTING>(dt, player.x, player.y);
+
+    // Dead enemies (including any which have just died)
+    for (uint16_t i = 0; i < enemies.size(); i++) {
+        if (enemies.health[i] == 0) {
+            Enemy(enemies, i).update_death(dt);
+        }
     }
 }
 
@@ -4845,8 +6488,18 @@ void update_coins(float dt) {
 
 
 void update_projectiles(float dt) {
-    for (uint8_t i = 0; i < projectiles.size(); i++) {
-        projectiles[i].update(dt, buttonStates);
+    for (uint16_t i = 0; i < projectiles.size(); i++) {
+        if (projectiles.flags[i] & ENTITY_FLAG_GRAVITY) {
+            // Update gravity
+            projectiles.yVel[i] += PROJECTILE_GRAVITY * dt;
+            projectiles.yVel[i] = std::min(projectiles.yVel[i], (float)PROJECTILE_GRAVITY_MAX);
+        }
+
+        // Move entity y
+        projectiles.y[i] += projectiles.yVel[i] * dt;
+
+        // Move entity x
+        projectiles.x[i] += projectiles.xVel[i] * dt;
     }
 
     //  Allow enemies to get hit?
@@ -4854,62 +6507,46 @@ void update_projectiles(float dt) {
 
     }*/
 
-    if (!player.is_immune()) {
-        uint8_t projectileCount = projectiles.size();
-        projectiles.erase(std::remove_if(projectiles.begin(), projectiles.end(), [](Projectile projectile) { return projectile.is_colliding(player.x, player.y); }), projectiles.end());
-        if (projectileCount - projectiles.size() > 0) {
-            player.health -= 1;
-            player.set_immune();
-        }
-    }
-    
-
-    projectiles.erase(std::remove_if(projectiles.begin(), projectiles.end(), [](Projectile projectile) { return (std::abs(projectile.x - player.x) > SCREEN_TILE_SIZE || std::abs(projectile.y - player.y) > SCREEN_HEIGHT); }), projectiles.end());
+    // Everything has moved now, so bring the broadphase up to date (also used for player collisions next frame)
+    broadphase.update();
 
-}
+    bool playerHit = false;
 
-void update_particles(float dt) {
-    for (uint16_t i = 0; i < imageParticles.size(); i++) {
-        imageParticles[i].update(dt);
-    }
+    if (!player.is_immune()) {
+        broadphase.query(player.x, player.y, player.x + SPRITE_SIZE, player.y + SPRITE_SIZE);
 
-    if (gameState == GameState::STATE_LEVEL_SELECT) {
-        snowGenTimer += dt;
-        while (snowGenTimer >= SNOW_LEVEL_SELECT_GENERATE_DELAY) {
-            snowGenTimer -= SNOW_LEVEL_SELECT_GENERATE_DELAY;
-            // Generate snow particles
-            // Get random position
-            float xVel = rand() % 3 - 1;
-            float yVel = rand() % 5 + 8;
-            uint16_t startX = (levelTriggers[(SNOW_WORLD * LEVELS_PER_WORLD) - 1].x + levelTriggers[SNOW_WORLD * LEVELS_PER_WORLD].x) / 2;
-            //uint16_t endX = (levelTriggers[((SNOW_WORLD + 1) * LEVELS_PER_WORLD) - 1].x + levelTriggers[(SNOW_WORLD + 1) * LEVELS_PER_WORLD].x) / 2;
-            uint16_t endX = (levelTriggers[((SNOW_WORLD + 1) * LEVELS_PER_WORLD)].x + levelTriggers[((SNOW_WORLD + 1) * LEVELS_PER_WORLD) + 1].x) / 2;
-            float x = (rand() % (endX - startX)) + startX;
-            if ((x > levelTriggers[SNOW_WORLD * LEVELS_PER_WORLD].x && x < levelTriggers[(SNOW_WORLD + 1) * LEVELS_PER_WORLD].x) || rand() % 2 == 0) {
-                // At edges, only make a half as many particles
-                imageParticles.push_back(ImageParticle(x, -SPRITE_SIZE * 8, xVel, yVel, 0, 0, snowParticleImages[rand() % snowParticleImages.size()]));
+        for (uint16_t n = 0; n < broadphase.nearbyProjectiles.size(); n++) {
+            uint16_t i = broadphase.nearbyProjectiles[n];
+            if (projectile_colliding(i, player.x, player.y)) {
+                projectiles.flags[i] |= ENTITY_FLAG_HIT;
+                playerHit = true;
             }
         }
     }
-    else if (currentWorldNumber == SNOW_WORLD || currentLevelNumber == 8) {
-        snowGenTimer += dt;
-        while (snowGenTimer >= SNOW_LEVEL_GENERATE_DELAY) {
-            snowGenTimer -= SNOW_LEVEL_GENERATE_DELAY;
-            // Generate snow particles
-            // Get random position
-            float xVel = rand() % 3 - 1;
-            float yVel = rand() % 5 + 8;
-            float x = (rand() % (levelData.levelWidth * SPRITE_SIZE + SCREEN_WIDTH)) - SCREEN_MID_WIDTH;
-            imageParticles.push_back(ImageParticle(x, -SPRITE_SIZE * 8, xVel, yVel, 0, 0, snowParticleImages[rand() % snowParticleImages.size()]));
-        }
+
+    // Remove projectiles which have hit the player, hit a wall, or gone off screen, all in one pass
+    projectiles.remove_if([](uint16_t i) { return (projectiles.flags[i] & ENTITY_FLAG_HIT) || projectile_hit_wall(i) || projectile_off_screen(i, camera.x, camera.y); });
+
+    if (playerHit) {
+        player.health -= 1;
+        player.set_immune();
     }
+}
 
-    imageParticles.erase(std::remove_if(imageParticles.begin(), imageParticles.end(), [](ImageParticle particle) { return particle.y > levelDeathBoundary * 1.3f; }), imageParticles.end());
+void update_particles(float dt) {
+    snowField.update(dt);
 }
 
 void update_sg_icon(float dt, ButtonStates buttonStates) {
+    if (splashRendered) {
+        // Splash is visible, so load the rest now
+        init_deferred();
+    }
+
     if (splashColour.a == 255) {
         // Init game
+        init_deferred();
+
         gameState = GameState::STATE_INPUT_SELECT;
         init_game();
     }
@@ -4938,10 +6575,10 @@ void update_input_select(float dt, ButtonStates buttonStates) {
         }
     }
     else {
-        if (transition[0].is_ready_to_open()) {
+        if (transition.is_ready_to_open()) {
             start_menu();
         }
-        else if (transition[0].is_open()) {
+        else if (transition.is_open()) {
             if (gameSaveData.inputType == InputType::CONTROLLER) {
                 if (buttonStates.DOWN) {
                     gameSaveData.inputType = InputType::KEYBOARD;
@@ -4965,6 +6602,7 @@ void update_input_select(float dt, ButtonStates buttonStates) {
 
                 // Save inputType
                 save_game_data();
+                flush_save();
             }
         }
     }
@@ -4977,7 +6615,7 @@ void update_character_select(float dt, ButtonStates buttonStates) {
     player.update(dt, dummyStates);
 
 
-    if (transition[0].is_ready_to_open()) {
+    if (transition.is_ready_to_open()) {
         if (menuBack) {
             menuBack = false;
             start_menu();
@@ -4986,7 +6624,7 @@ void update_character_select(float dt, ButtonStates buttonStates) {
             start_level_select();
         }
     }
-    else if (transition[0].is_open()) {
+    else if (transition.is_open()) {
         if (buttonStates.RIGHT && !playerSelected) {
             audioHandler.play(0);
 
@@ -5030,7 +6668,7 @@ void update_menu(float dt, ButtonStates buttonStates) {
         }
     }
     else {
-        if (transition[0].is_ready_to_open()) {
+        if (transition.is_ready_to_open()) {
             if (menuBack) {
                 menuBack = false;
                 start_input_select();
@@ -5044,7 +6682,7 @@ void update_menu(float dt, ButtonStates buttonStates) {
                 }
             }
         }
-        else if (transition[0].is_open()) {
+        else if (transition.is_open()) {
             if (buttonStates.A == 2) {
                 audioHandler.play(0);
 
@@ -5072,7 +6710,7 @@ void update_settings(float dt, ButtonStates buttonStates) {
     update_coins(dt);
     update_checkpoint(dt);
 
-    if (transition[0].is_ready_to_open()) {
+    if (transition.is_ready_to_open()) {
         if (menuBack) {
             menuBack = false;
             start_menu();
@@ -5086,7 +6724,7 @@ void update_settings(float dt, ButtonStates buttonStates) {
             }
         }*/
     }
-    else if (transition[0].is_open()) {
+    else if (transition.is_open()) {
         if (buttonStates.A == 2) {
             audioHandler.play(0);
 
@@ -5108,8 +6746,9 @@ void update_settings(float dt, ButtonStates buttonStates) {
             // Exit settings
             audioHandler.play(0);
 
-            // Save settings data
+            // Save settings data (written once the transition covers the screen)
             save_game_data();
+            flush_save();
 
             menuBack = true;
             close_transition();
@@ -5130,6 +6769,9 @@ void update_level_select(float dt, ButtonStates buttonStates) {
 
     update_enemies(dt, buttonStates);
 
+    // No projectiles in level select, so keep the broadphase up to date here instead
+    broadphase.update();
+
     update_level_triggers(dt, buttonStates);
 
     update_particles(dt);
@@ -5137,7 +6779,7 @@ void update_level_select(float dt, ButtonStates buttonStates) {
 
     // Button handling
 
-    if (transition[0].is_ready_to_open()) {
+    if (transition.is_ready_to_open()) {
         if (menuBack) {
             menuBack = false;
             start_character_select();
@@ -5146,7 +6788,7 @@ void update_level_select(float dt, ButtonStates buttonStates) {
             start_level(currentLevelNumber);
         }
     }
-    else if (transition[0].is_open()) {
+    else if (transition.is_open()) {
         if (cameraNewWorld) {
             if (camera.tempX == 0.0f && camera.tempY == 0.0f) {
                 camera.tempX = camera.x;
@@ -5254,7 +6896,7 @@ void update_game(float dt, ButtonStates buttonStates) {
     //    player.y += (finish.y - player.y) * 4 * dt;
     //}
 
-    if (transition[0].is_ready_to_open()) {
+    if (transition.is_ready_to_open()) {
         if (pauseMenuItem == 1) {
             // Player exited level
             start_level_select();
@@ -5267,11 +6909,8 @@ void update_game(float dt, ButtonStates buttonStates) {
             // Player failed level
             start_game_lost();
         }
-
-        // Unload coin sfx, load select sfx file back into select sfx slot
-        audioHandler.load(0, 0);
     }
-    else if (transition[0].is_open()) {
+    else if (transition.is_open()) {
         if (gamePaused) {
             if (pauseMenuItem == 0) {
                 if (buttonStates.RIGHT == 2) {
@@ -5292,9 +6931,6 @@ void update_game(float dt, ButtonStates buttonStates) {
                 if (pauseMenuItem == 0) {
                     // Unpause game
                     gamePaused = false;
-
-                    // Load coin sfx file into select sfx slot
-                    audioHandler.load(0, 2);
                 }
                 else if (pauseMenuItem == 1) {
                     // Exit level
@@ -5372,15 +7008,11 @@ void update_game(float dt, ButtonStates buttonStates) {
         if (buttonStates.Y == 2) {
             if (gamePaused) {
                 audioHandler.play(0);
-                // Load coin sfx into select sfx slot
-                audioHandler.load(0, 2);
                 gamePaused = false;
             }
             else {
                 gamePaused = true;
                 pauseMenuItem = 0;
-                // Unload coin sfx, put select sfx back into select sfx slot
-                audioHandler.load(0, 0);
                 audioHandler.play(0);
             }
         }
@@ -5394,10 +7026,10 @@ void update_game_lost(float dt, ButtonStates buttonStates) {
     update_projectiles(dt);
     update_particles(dt);
 
-    if (transition[0].is_ready_to_open()) {
+    if (transition.is_ready_to_open()) {
         start_level_select();
     }
-    else if (transition[0].is_open()) {
+    else if (transition.is_open()) {
         if (buttonStates.A == 2) {
             audioHandler.play(0);
 
@@ -5414,10 +7046,10 @@ void update_game_won(float dt, ButtonStates buttonStates) {
     update_projectiles(dt);
     update_particles(dt);
 
-    if (transition[0].is_ready_to_open()) {
+    if (transition.is_ready_to_open()) {
         start_level_select();
     }
-    else if (transition[0].is_open()) {
+    else if (transition.is_open()) {
         if (buttonStates.A == 2) {
             audioHandler.play(0);
 
@@ -5427,7 +7059,7 @@ void update_game_won(float dt, ButtonStates buttonStates) {
 }
 
 void init_game() {
-    bool success = read_save(gameSaveData);
+    bool success = saveLoaded;
 
     // Load save data
     // Attempt to load the first save slot.
@@ -5492,29 +7124,54 @@ void init_game() {
         save_game_data();
 #endif
     }
+
+    // Writes the migrated legacy save (or the defaults on 32blit)
+    flush_save();
 }
 
-void load_audio() {
-    // NOTE: CURRENTLY ISSUE WITH LEAVING PAUSE MENU, blip AUDIO IS PLAYED, BUT THEN NEW SOUND IS LOADED IN, STOPPING PLAYBACK.
+void log_startup_phase(const char* phase) {
+    // Print how long the phase took, and the time since init() started
+    uint32_t time = now_us();
+    printf("Startup: %s took %lu us (%lu us total)\n", phase, (unsigned long)us_diff(startupPhaseTime, time), (unsigned long)us_diff(startupTime, time));
+    startupPhaseTime = time;
+}
 
+void start_splash_music() {
     // Set volume to a default
     audioHandler.set_volume(DEFAULT_VOLUME);
-    // Sfx
-    audioHandler.load(0, asset_sound_select, asset_sound_select_length);
-    audioHandler.load(1, asset_sound_jump, asset_sound_jump_length);
-    audioHandler.load(2, asset_sound_coin, asset_sound_coin_length);
-    audioHandler.load(3, asset_sound_enemydeath, asset_sound_enemydeath_length);
-    audioHandler.load(4, asset_sound_enemyinjured, asset_sound_enemyinjured_length);
-    audioHandler.load(5, asset_sound_playerdeath, asset_sound_playerdeath_length);
-    audioHandler.load(6, asset_sound_enemythrow, asset_sound_enemythrow_length);
+
     // Music
-    audioHandler.load(7, asset_music_splash, asset_music_splash_length);
+    audioHandler.load_music(asset_music_splash, asset_music_splash_length);
 
     // Start splash music playing
-    audioHandler.play(7);
+    audioHandler.play_music();
+}
+
+void load_audio() {
+    // NOTE: CURRENTLY ISSUE WITH LEAVING PAUSE MENU, blip AUDIO IS PLAYED, BUT THEN NEW SOUND IS LOADED IN, STOPPING PLAYBACK.
 
-    // Note: to play sfx0, call audioHandler.play(0)
-    // For music, need to load sound when changing (i.e. audioHandler.load(7, asset_music_<music>, asset_music_<music>_length); audioHandler.play(7, 0b11);
+    // Sfx (last argument is priority, used when all channels are busy)
+#ifdef CACHE_SFX
+    // Decode once now, so that playing them doesn't need any mp3 decoding
+    audioHandler.load_cached(0, asset_sound_select, asset_sound_select_length, 2);
+    audioHandler.load_cached(1, asset_sound_jump, asset_sound_jump_length, 1);
+    audioHandler.load_cached(2, asset_sound_coin, asset_sound_coin_length, 1);
+    audioHandler.load_cached(3, asset_sound_enemydeath, asset_sound_enemydeath_length, 2);
+    audioHandler.load_cached(4, asset_sound_enemyinjured, asset_sound_enemyinjured_length, 1);
+    audioHandler.load_cached(5, asset_sound_playerdeath, asset_sound_playerdeath_length, 3);
+    audioHandler.load_cached(6, asset_sound_enemythrow, asset_sound_enemythrow_length, 0);
+#else
+    audioHandler.load(0, asset_sound_select, asset_sound_select_length, 2);
+    audioHandler.load(1, asset_sound_jump, asset_sound_jump_length, 1);
+    audioHandler.load(2, asset_sound_coin, asset_sound_coin_length, 1);
+    audioHandler.load(3, asset_sound_enemydeath, asset_sound_enemydeath_length, 2);
+    audioHandler.load(4, asset_sound_enemyinjured, asset_sound_enemyinjured_length, 1);
+    audioHandler.load(5, asset_sound_playerdeath, asset_sound_playerdeath_length, 3);
+    audioHandler.load(6, asset_sound_enemythrow, asset_sound_enemythrow_length, 0);
+#endif // CACHE_SFX
+
+    // Note: to play sfx0, call audioHandler.play(0) (it will be given a free channel)
+    // For music, need to load sound when changing (i.e. audioHandler.load_music(asset_music_<music>, asset_music_<music>_length); audioHandler.play_music(0b11);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -5524,36 +7181,48 @@ void load_audio() {
 // setup your game here
 //
 void init() {
+    startupTime = startupPhaseTime = now_us();
+
     set_screen_mode(ScreenMode::lores);
 
+    // Only load what the splash screen needs, everything else is done by init_deferred() once it's visible
+    sg_icon_image = Surface::load(asset_scorpion_games);
+    log_startup_phase("splash image");
+
+    start_splash_music();
+    log_startup_phase("splash music");
+}
+
+void init_deferred() {
+    if (deferredInitDone) {
+        return;
+    }
+
+    log_startup_phase("first splash frame");
+
     screen.sprites = Surface::load(asset_sprites);
+    background_image = Surface::load(asset_background);
+    find_opaque_sprites();
+    log_startup_phase("images");
 
     // Load metadata
     metadata = get_metadata();
     gameVersion = parse_version(metadata.version);
     printf("Loaded metadata. Game version: %d (v%d.%d.%d)\n", get_version(gameVersion), gameVersion.major, gameVersion.minor, gameVersion.build);
 
-    // Populate transition array
-    for (uint8_t y = 0; y < SCREEN_HEIGHT / SPRITE_SIZE; y++) {
-        for (uint8_t x = 0; x < SCREEN_WIDTH / SPRITE_SIZE; x++) {
-            transition[y * (SCREEN_WIDTH / SPRITE_SIZE) + x] = AnimatedTransition(x * SPRITE_SIZE, y * SPRITE_SIZE, transitionFramesOpen, transitionFramesClose);
-        }
-    }
-
-
-    allPlayerSaveData[0] = load_player_data(0);
-    allPlayerSaveData[1] = load_player_data(1);
-
-    // Load level data
-    for (uint8_t i = 0; i < LEVEL_COUNT; i++) {
-        allLevelSaveData[0][i] = load_level_data(0, i);
-    }
-    for (uint8_t i = 0; i < LEVEL_COUNT; i++) {
-        allLevelSaveData[1][i] = load_level_data(1, i);
-    }
+    // Load save data (game settings are checked in init_game)
+    saveLoaded = load_save();
 
+#ifndef TARGET_32BLIT_HW
+    // Don't lose a pending save when the window is closed
+    std::atexit(commit_save);
+#endif
+    log_startup_phase("save data");
 
     load_audio();
+    log_startup_phase("sfx");
+
+    deferredInitDone = true;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -5563,10 +7232,143 @@ void init() {
 // This function is called to perform rendering of the game. time is the 
 // amount if milliseconds elapsed since the start of your game
 //
+bool is_static_screen() {
+    // Menu screens where only the prompt, selection or a few animations change.
+    // Not while the transition or splash fade is drawn over the top, or the camera is shaking.
+    return (gameState == GameState::STATE_INPUT_SELECT || gameState == GameState::STATE_MENU || gameState == GameState::STATE_SETTINGS) && transition.is_open() && splashColour.a == 0 && checkpoint.particles.size() == 0;
+}
+
+void mark_static_screen_dirty() {
+    uint32_t key = (uint32_t)gameState | (menuItem << 4) | (settingsItem << 6) | (gameSaveData.inputType << 8) | (gameSaveData.checkpoints << 9) | (gameSaveData.musicVolume << 10) | (gameSaveData.sfxVolume << 11);
+    Point cameraPosition = Point(camera.x, camera.y);
+
+    if (key != staticScreenKey || cameraPosition.x != staticScreenCamera.x || cameraPosition.y != staticScreenCamera.y) {
+        // Selection or settings changed, or the camera moved
+        staticScreenKey = key;
+        staticScreenCamera = cameraPosition;
+        dirtyRegions.invalidate();
+    }
+
+    bool prompt = textFlashTimer < TEXT_FLASH_TIME * 0.6f;
+
+    if (prompt != staticScreenPrompt) {
+        // Prompt is drawn in the bottom bar
+        staticScreenPrompt = prompt;
+        dirtyRegions.add(Rect(0, SCREEN_HEIGHT - (SPRITE_SIZE + 12), SCREEN_WIDTH, SPRITE_SIZE + 12));
+    }
+
+    if (gameState != GameState::STATE_INPUT_SELECT) {
+        // Animated level objects
+        for (uint16_t i = 0; i < coins.size(); i++) {
+            if (coins[i].take_frame_changed()) {
+                dirtyRegions.add(Rect(SCREEN_MID_WIDTH + coins[i].x - camera.x, SCREEN_MID_HEIGHT + coins[i].y - camera.y, SPRITE_SIZE, SPRITE_SIZE));
+            }
+        }
+
+        if (checkpoint.take_frame_changed()) {
+            dirtyRegions.add(Rect(SCREEN_MID_WIDTH + checkpoint.x - camera.x, SCREEN_MID_HEIGHT + checkpoint.y - camera.y - SPRITE_SIZE, SPRITE_SIZE, SPRITE_SIZE));
+        }
+    }
+}
+
+// Idle mode state
+uint32_t lastInputTime = 0;
+uint32_t lastIdleUpdateTime = 0;
+bool idleActive = false;
+bool frameUpdated = true; // Set when update() has run since the last render()
+
+// Number of updates and renders skipped by idle mode (this idle period, and since boot)
+uint32_t idleSkippedUpdates = 0;
+uint32_t idleSkippedRenders = 0;
+uint32_t totalIdleSkippedFrames = 0;
+
+bool is_idle_state() {
+    // Nothing moves except a few slow animations
+    return (gameState == GameState::STATE_IN_GAME && gamePaused && transition.is_open()) || is_static_screen();
+}
+
+// Returns true if this update can be skipped
+bool update_idle(uint32_t time) {
+    if (buttons) {
+        // Wake immediately on input
+        lastInputTime = time;
+    }
+
+    bool idle = is_idle_state() && time - lastInputTime >= IDLE_WAKE_TIME;
+
+    if (idle != idleActive) {
+        idleActive = idle;
+
+        if (!idle && (idleSkippedUpdates || idleSkippedRenders)) {
+            printf("Idle mode ended, skipped %lu updates and %lu renders (%lu total)\n", (unsigned long)idleSkippedUpdates, (unsigned long)idleSkippedRenders, (unsigned long)totalIdleSkippedFrames);
+        }
+
+        idleSkippedUpdates = idleSkippedRenders = 0;
+    }
+
+    if (idle && time - lastIdleUpdateTime < IDLE_UPDATE_INTERVAL) {
+        idleSkippedUpdates++;
+        totalIdleSkippedFrames++;
+        return true;
+    }
+
+    lastIdleUpdateTime = time;
+    return false;
+}
+
+void render_static_screen() {
+    // All static screens start with the background image
+    if (!backgroundCoversScreen) {
+        screen.pen = Pen(splashColour.r, splashColour.g, splashColour.b);
+        screen.clear();
+    }
+
+    screen.alpha = 255;
+    screen.mask = nullptr;
+    screen.pen = Pen(defaultWhite.r, defaultWhite.g, defaultWhite.b);
+
+    if (gameState == GameState::STATE_INPUT_SELECT) {
+        render_input_select();
+    }
+    else if (gameState == GameState::STATE_MENU) {
+        render_menu();
+    }
+    else if (gameState == GameState::STATE_SETTINGS) {
+        render_settings();
+    }
+}
+
 void render(uint32_t time) {
+    if (idleActive && !frameUpdated) {
+        // Nothing has changed, last frame is still in the framebuffer
+        idleSkippedRenders++;
+        totalIdleSkippedFrames++;
+        return;
+    }
+
+    frameUpdated = false;
+
+    uint32_t renderStart = now_us();
+
+    if (is_static_screen()) {
+        // Only repaint the parts which have changed since last frame
+        mark_static_screen_dirty();
+        dirtyRegions.render(render_static_screen);
+
+        // Menus aren't counted, their cost depends on how much changed
+        frameUpdateTime = 0;
+        return;
+    }
+
+    // Whole screen is drawn, so next static screen needs to start from scratch
+    dirtyRegions.invalidate();
+
     // clear the screen -- screen is a reference to the frame buffer and can be used to draw all things with the 32blit
-    screen.pen = Pen(splashColour.r, splashColour.g, splashColour.b);
-    screen.clear();
+    // Every state apart from the splash screen draws the background image first, so skip the clear if that covers the screen anyway
+    if (!backgroundCoversScreen || gameState == GameState::STATE_SG_ICON) {
+        screen.pen = Pen(splashColour.r, splashColour.g, splashColour.b);
+        screen.clear();
+    }
 
     // draw some text at the top of the screen
     screen.alpha = 255;
@@ -5575,6 +7377,7 @@ void render(uint32_t time) {
 
     if (gameState == GameState::STATE_SG_ICON) {
         render_sg_icon();
+        splashRendered = true;
     }
     else if (gameState == GameState::STATE_INPUT_SELECT) {
         render_input_select();
@@ -5604,9 +7407,12 @@ void render(uint32_t time) {
     render_transition();
 
     if (splashColour.a != 0) {
-        screen.pen = Pen(splashColour.r, splashColour.g, splashColour.b, splashColour.a);
-        screen.clear();
+        tint_rect(Rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT), splashColour);
     }
+
+    // Adjust quality for the next frames
+    quality.add_frame(frameUpdateTime + us_diff(renderStart, now_us()));
+    frameUpdateTime = 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -5617,6 +7423,17 @@ void render(uint32_t time) {
 // amount if milliseconds elapsed since the start of your game
 //
 void update(uint32_t time) {
+    if (update_idle(time)) {
+        // Keep music playing and saves going while idle, the game itself waits (dt accumulates until the next update)
+        update_save(0.0f, true);
+        audioHandler.update();
+        return;
+    }
+
+    frameUpdated = true;
+
+    uint32_t updateStart = now_us();
+
     // Get dt
     dt = (time - lastTime) / 1000.0;
     lastTime = time;
@@ -5755,9 +7572,23 @@ void update(uint32_t time) {
 
     update_transition(dt, buttonStates);
 
+    // Write pending save data while the transition hides the screen, so that a slow write isn't noticed
+    update_save(dt, transition.is_closed() || transition.is_ready_to_open());
+
     // Screen shake
     camera.x += shaker.time_to_shake(dt);
     camera.y += shaker.time_to_shake(dt);
 
     audioHandler.update();
+
+    frameUpdateTime += us_diff(updateStart, now_us());
+
+#ifdef PRINT_AUDIO_STATS
+    static uint32_t lastAudioStatsTime = 0;
+    if (time - lastAudioStatsTime >= AUDIO_STATS_INTERVAL) {
+        audioHandler.print_stats();
+        audioHandler.reset_stats();
+        lastAudioStatsTime = time;
+    }
+#endif // PRINT_AUDIO_STATS
 }
\ No newline at end of file